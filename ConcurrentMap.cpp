@@ -0,0 +1,198 @@
+#pragma once
+
+#include "UnMap.cpp"
+#include <shared_mutex>
+#include <mutex>
+#include <thread>
+#include <memory>
+
+// Keys are partitioned by hash between independently locked UnorderedMaps.
+// Each shard has its own reader/writer lock, grows on its own and, with the default
+// FastAllocator, allocates its nodes from its own pool.
+// Nothing hands out iterators or references: values are copied out or visited under the lock.
+template<
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = FastAllocator<std::pair<const Key, Value> > >
+class ConcurrentMap {
+public:
+    using MapType = UnorderedMap<Key, Value, Hash, Equal, Alloc>;
+    using NodeType = typename MapType::NodeType;
+
+private:
+    static const size_t cacheLine_ = 64;
+    static const size_t shardsPerThread_ = 4;
+
+    class alignas(cacheLine_) Shard_ {
+    public:
+        mutable std::shared_mutex lock;
+        MapType map;
+    };
+
+    std::unique_ptr<Shard_[]> shards_;
+    size_t shardCount_;
+    size_t shardShift_;
+    Hash hashFunction_;
+
+    // The shard of a key hash. The shards' maps hash with their own default-constructed Hash,
+    // so they are given this hash instead of computing it again.
+    Shard_& shardFor_(size_t hash) const;
+
+public:
+    explicit ConcurrentMap(size_t shardCount = 0);
+    ConcurrentMap(const ConcurrentMap& other) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap& other) = delete;
+
+    size_t size() const;
+    size_t shard_count() const {return shardCount_;}
+    bool contains(const Key& key) const;
+    bool find(const Key& key, Value& result) const;
+    template<typename F>
+    bool visit(const Key& key, F&& f) const;
+    bool insert(const Key& key, const Value& value);
+    template<typename V>
+    bool insert_or_assign(const Key& key, V&& value);
+    template<typename F>
+    bool compute(const Key& key, F&& f);
+    bool erase(const Key& key);
+    template<typename F>
+    void for_each(F&& f) const;
+    void reserve(size_t count);
+    void incremental_rehash(size_t bucketsPerStep);
+};
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+ConcurrentMap<Key, Value, Hash, Equal, Alloc>::ConcurrentMap(size_t shardCount) {
+    if (!shardCount) {
+        shardCount = std::thread::hardware_concurrency() * shardsPerThread_;
+    }
+
+    shardCount_ = 1;
+    size_t bits = 0;
+    while (shardCount_ < shardCount) {
+        shardCount_ <<= 1;
+        ++bits;
+    }
+    shardShift_ = 64 - bits;
+    shards_.reset(new Shard_[shardCount_]);
+}
+
+// The shard is taken from the top bits of a multiplicative hash with its own constant,
+// so keys of one shard still spread over all buckets of its map.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename ConcurrentMap<Key, Value, Hash, Equal, Alloc>::Shard_& ConcurrentMap<Key, Value, Hash, Equal, Alloc>::shardFor_(size_t hash) const {
+    if (shardCount_ == 1) {
+        return shards_[0];
+    }
+    uint64_t x = static_cast<uint64_t>(hash);
+    x ^= x >> 32;
+    x *= 0xD6E8FEB86659FD93ULL;
+    return shards_[static_cast<size_t>(x >> shardShift_)];
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t ConcurrentMap<Key, Value, Hash, Equal, Alloc>::size() const {
+    size_t answer = 0;
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::shared_lock<std::shared_mutex> guard(shards_[i].lock);
+        answer += shards_[i].map.size();
+    }
+    return answer;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::contains(const Key& key) const {
+    size_t hash = hashFunction_(key);
+    const Shard_& shard = shardFor_(hash);
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.map.findNode_(key, hash);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::find(const Key& key, Value& result) const {
+    return visit(key, [&result](const Value& value) {result = value;});
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename F>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::visit(const Key& key, F&& f) const {
+    size_t hash = hashFunction_(key);
+    const Shard_& shard = shardFor_(hash);
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    typename MapType::NodePtr found = shard.map.findNode_(key, hash);
+    if (!found) {
+        return false;
+    }
+    f(static_cast<const Value&>(found->data_.second));
+    return true;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::insert(const Key& key, const Value& value) {
+    size_t hash = hashFunction_(key);
+    Shard_& shard = shardFor_(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.map.tryEmplace_(hash, key, value).second;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename V>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::insert_or_assign(const Key& key, V&& value) {
+    size_t hash = hashFunction_(key);
+    Shard_& shard = shardFor_(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.map.insertOrAssign_(hash, key, std::forward<V>(value)).second;
+}
+
+// Calls f on the value of key under the shard's write lock, default-constructing it first
+// if the key is absent. Returns whether the key was inserted.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename F>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::compute(const Key& key, F&& f) {
+    size_t hash = hashFunction_(key);
+    Shard_& shard = shardFor_(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    std::pair<typename MapType::iterator, bool> result = shard.map.tryEmplace_(hash, key);
+    f((*result.first).second);
+    return result.second;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+bool ConcurrentMap<Key, Value, Hash, Equal, Alloc>::erase(const Key& key) {
+    size_t hash = hashFunction_(key);
+    Shard_& shard = shardFor_(hash);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.map.eraseKey_(key, hash) != 0;
+}
+
+// Visits the shards one after another, so it sees each shard at a consistent point
+// but not the whole map at one moment.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename F>
+void ConcurrentMap<Key, Value, Hash, Equal, Alloc>::for_each(F&& f) const {
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::shared_lock<std::shared_mutex> guard(shards_[i].lock);
+        for (typename MapType::const_iterator it = shards_[i].map.cbegin(); it != shards_[i].map.cend(); ++it) {
+            f(*it);
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void ConcurrentMap<Key, Value, Hash, Equal, Alloc>::reserve(size_t count) {
+    size_t perShard = count / shardCount_ + 1;
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::unique_lock<std::shared_mutex> guard(shards_[i].lock);
+        shards_[i].map.reserve(perShard);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void ConcurrentMap<Key, Value, Hash, Equal, Alloc>::incremental_rehash(size_t bucketsPerStep) {
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::unique_lock<std::shared_mutex> guard(shards_[i].lock);
+        shards_[i].map.incremental_rehash(bucketsPerStep);
+    }
+}
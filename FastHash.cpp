@@ -0,0 +1,293 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <random>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Hash functions for the Hash argument of UnorderedMap and the maps built on it.
+// They declare is_avalanching: every bit of the key changes about half of the bits of the result,
+// so the map takes the low bits of the result as the bucket without mixing it again, see DefaultBuckets.
+
+// True when T declares is_avalanching: its results are already well mixed and need no finalizer.
+template<typename T, typename = void>
+class IsAvalanching : public std::false_type {};
+
+template<typename T>
+class IsAvalanching<T, std::void_t<typename T::is_avalanching> > : public std::true_type {};
+
+// Random odd constants, the keys of BytesHash and the integer hashes.
+inline constexpr uint64_t hashSecret[24] = {
+    0x07C3E62447CE57E9ULL, 0x2EC746997017125FULL, 0x1F1D1F01A9D9A511ULL,
+    0xE46893867C089F4FULL, 0x86056A0ACB0B79A3ULL, 0x87CFFFACF078F425ULL,
+    0xC0DF8EB985855A47ULL, 0xF13A2D6E8E1AE977ULL, 0xDB0AF0C78DAB8A6DULL,
+    0x964DC0C2546E2301ULL, 0x7A451E772D22BF79ULL, 0xFA8C2E87ECDC92F9ULL,
+    0x6598D69183535923ULL, 0x903E33C18CC9C5BDULL, 0x2DAC5231161DCA47ULL,
+    0x2F6F4CE7B583D83DULL, 0x40B8106029E0DDABULL, 0xE7849B9950A04F7FULL,
+    0xC3774FAA730EF045ULL, 0x22F412CB909429DBULL, 0xD971395EB58FE03FULL,
+    0x53ADE73A011C4BF9ULL, 0x2D99C8C3FA1ED6CFULL, 0x03332693CC80B94DULL};
+
+// Full 128-bit product of a and b, the low half is left in a and the high half in b.
+inline void hashMultiply(uint64_t& a, uint64_t& b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(product);
+    b = static_cast<uint64_t>(product >> 64);
+#else
+    uint64_t aLow = a & 0xFFFFFFFF, aHigh = a >> 32, bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+    uint64_t low = aLow * bLow, middle1 = aHigh * bLow, middle2 = aLow * bHigh, high = aHigh * bHigh;
+    uint64_t carry = ((low >> 32) + (middle1 & 0xFFFFFFFF) + (middle2 & 0xFFFFFFFF)) >> 32;
+    a *= b;
+    b = high + (middle1 >> 32) + (middle2 >> 32) + carry;
+#endif
+}
+
+// Folds the 128-bit product: one multiplication, the fast mixer of the integer hashes.
+inline uint64_t hashMum(uint64_t a, uint64_t b) {
+    hashMultiply(a, b);
+    return a ^ b;
+}
+
+// Bijective finalizer (splitmix64), slower than hashMum but with full avalanche for any input.
+inline uint64_t hashMix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Hash of a byte string. Up to 128 bytes it multiplies 16 bytes at a time like wyhash. Longer
+// strings are read in 64-byte stripes into eight independent 64-bit lanes like xxh3, with AVX2
+// or SSE2 where the target has them. Every path gives the same value on a little-endian machine.
+class BytesHash {
+private:
+    static const size_t stripe_ = 64;
+    static const size_t stripesPerBlock_ = 16;
+    static const size_t scrambleKey_ = 16;
+    static const size_t lastStripeKey_ = 11;
+    static constexpr uint64_t prime32_ = 0x9E3779B1;
+
+    static uint64_t read64_(const unsigned char* p) {uint64_t x; std::memcpy(&x, p, sizeof(x)); return x;}
+    static uint64_t read32_(const unsigned char* p) {uint32_t x; std::memcpy(&x, p, sizeof(x)); return x;}
+
+    static uint64_t finish_(uint64_t a, uint64_t b, uint64_t seed, size_t length) {
+        a ^= hashSecret[1];
+        b ^= seed;
+        hashMultiply(a, b);
+        return hashMum(a ^ hashSecret[0] ^ length, b ^ hashSecret[1]);
+    }
+
+    static uint64_t short_(const unsigned char* p, size_t length, uint64_t seed);
+    static uint64_t long_(const unsigned char* p, size_t length, uint64_t seed);
+    static void accumulate_(uint64_t* acc, const unsigned char* p, const uint64_t* key);
+    static void scramble_(uint64_t* acc, const uint64_t* key);
+
+public:
+    static uint64_t hash(const void* data, size_t length, uint64_t seed = 0) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        return length <= 128 ? short_(p, length, seed ^ hashSecret[2]) : long_(p, length, seed);
+    }
+};
+
+inline uint64_t BytesHash::short_(const unsigned char* p, size_t length, uint64_t seed) {
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t middle = (length >> 3) << 2;
+            a = (read32_(p) << 32) | read32_(p + middle);
+            b = (read32_(p + length - 4) << 32) | read32_(p + length - 4 - middle);
+        } else if (length > 0) {
+            a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[length >> 1]) << 8) | p[length - 1];
+        }
+        return finish_(a, b, seed, length);
+    }
+
+    size_t left = length;
+    for (; left > 16; left -= 16, p += 16) {
+        seed = hashMum(read64_(p) ^ hashSecret[1], read64_(p + 8) ^ seed);
+    }
+    a = read64_(p + left - 16);
+    b = read64_(p + left - 8);
+    return finish_(a, b, seed, length);
+}
+
+// Lane i takes the product of the halves of its keyed word and, so that no word is lost when the
+// product is zero, the plain word of lane i ^ 1. Every block of 16 stripes ends with a scramble.
+inline uint64_t BytesHash::long_(const unsigned char* p, size_t length, uint64_t seed) {
+    uint64_t key[24];
+    for (size_t i = 0; i < 24; ++i) {
+        key[i] = hashSecret[i] + (i & 1 ? 0 - seed : seed);
+    }
+    alignas(32) uint64_t acc[8] = {
+        hashSecret[23], hashSecret[22], hashSecret[21], hashSecret[20],
+        hashSecret[19], hashSecret[18], hashSecret[17], hashSecret[16]};
+
+    size_t stripes = (length - 1) / stripe_;
+    size_t done = 0;
+    for (; done + stripesPerBlock_ <= stripes; done += stripesPerBlock_) {
+        for (size_t s = 0; s < stripesPerBlock_; ++s) {
+            accumulate_(acc, p + (done + s) * stripe_, key + s);
+        }
+        scramble_(acc, key + scrambleKey_);
+    }
+    for (size_t s = 0; done + s < stripes; ++s) {
+        accumulate_(acc, p + (done + s) * stripe_, key + s);
+    }
+    accumulate_(acc, p + length - stripe_, key + lastStripeKey_);
+
+    uint64_t answer = length * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < 8; i += 2) {
+        answer += hashMum(acc[i] ^ key[scrambleKey_ + i], acc[i + 1] ^ key[scrambleKey_ + i + 1]);
+    }
+    return hashMix(answer);
+}
+
+inline void BytesHash::accumulate_(uint64_t* acc, const unsigned char* p, const uint64_t* key) {
+#if defined(__AVX2__)
+    for (size_t i = 0; i < 8; i += 4) {
+        __m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 8 * i));
+        __m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + i)));
+        __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+        __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        lanes = _mm256_add_epi64(lanes, _mm256_add_epi64(product, swapped));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), lanes);
+    }
+#elif defined(__SSE2__)
+    for (size_t i = 0; i < 8; i += 2) {
+        __m128i lanes = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8 * i));
+        __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + i)));
+        __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+        __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        lanes = _mm_add_epi64(lanes, _mm_add_epi64(product, swapped));
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), lanes);
+    }
+#else
+    for (size_t i = 0; i < 8; ++i) {
+        uint64_t data = read64_(p + 8 * i);
+        uint64_t keyed = data ^ key[i];
+        acc[i ^ 1] += data;
+        acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+    }
+#endif
+}
+
+inline void BytesHash::scramble_(uint64_t* acc, const uint64_t* key) {
+#if defined(__AVX2__)
+    __m256i prime = _mm256_set1_epi32(static_cast<int>(prime32_));
+    for (size_t i = 0; i < 8; i += 4) {
+        __m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+        lanes = _mm256_xor_si256(lanes, _mm256_srli_epi64(lanes, 47));
+        lanes = _mm256_xor_si256(lanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + i)));
+        __m256i low = _mm256_mul_epu32(lanes, prime);
+        __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(lanes, 32), prime);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+    }
+#elif defined(__SSE2__)
+    __m128i prime = _mm_set1_epi32(static_cast<int>(prime32_));
+    for (size_t i = 0; i < 8; i += 2) {
+        __m128i lanes = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+        lanes = _mm_xor_si128(lanes, _mm_srli_epi64(lanes, 47));
+        lanes = _mm_xor_si128(lanes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + i)));
+        __m128i low = _mm_mul_epu32(lanes, prime);
+        __m128i high = _mm_mul_epu32(_mm_srli_epi64(lanes, 32), prime);
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+    }
+#else
+    for (size_t i = 0; i < 8; ++i) {
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ key[i]) * prime32_;
+    }
+#endif
+}
+
+// Seeds of SeededHash objects made without one: random per process and different for every object.
+inline uint64_t nextHashSeed() {
+    static const uint64_t base = (static_cast<uint64_t>(std::random_device()()) << 32) ^ std::random_device()();
+    static std::atomic<uint64_t> counter(0);
+    return hashMix(base + counter.fetch_add(1, std::memory_order_relaxed) * 0x9E3779B97F4A7C15ULL);
+}
+
+// Unseeded hashes: the same values in every process, as MappedMap snapshots need.
+template<typename T, typename = void>
+class FastHash;
+
+template<typename T>
+class FastHash<T, std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> > {
+public:
+    using is_avalanching = void;
+    size_t operator()(T key) const {
+        return static_cast<size_t>(hashMum(static_cast<uint64_t>(key) ^ hashSecret[0], hashSecret[1]));
+    }
+};
+
+template<typename T>
+class FastHash<T*> {
+public:
+    using is_avalanching = void;
+    size_t operator()(T* key) const {
+        return static_cast<size_t>(hashMum(reinterpret_cast<uintptr_t>(key) ^ hashSecret[0], hashSecret[1]));
+    }
+};
+
+template<>
+class FastHash<std::string_view> {
+public:
+    using is_avalanching = void;
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const {return static_cast<size_t>(BytesHash::hash(key.data(), key.size()));}
+};
+
+template<>
+class FastHash<std::string> : public FastHash<std::string_view> {};
+
+// Hashes keyed by a secret seed against hash flooding: without the seed, keys that collide
+// cannot be chosen in advance. A map copies the seed with its Hash, so copies stay consistent.
+template<typename T, typename = void>
+class SeededHash;
+
+template<typename T>
+class SeededHash<T, std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> > {
+private:
+    uint64_t seed_;
+    uint64_t multiplier_;
+
+public:
+    using is_avalanching = void;
+    SeededHash() : SeededHash(nextHashSeed()) {}
+    explicit SeededHash(uint64_t seed) : seed_(seed ^ hashSecret[0]), multiplier_(hashMix(seed) ^ hashSecret[1]) {}
+    size_t operator()(T key) const {
+        return static_cast<size_t>(hashMum(static_cast<uint64_t>(key) ^ seed_, multiplier_));
+    }
+};
+
+template<>
+class SeededHash<std::string_view> {
+private:
+    uint64_t seed_;
+
+public:
+    using is_avalanching = void;
+    using is_transparent = void;
+    SeededHash() : seed_(nextHashSeed()) {}
+    explicit SeededHash(uint64_t seed) : seed_(seed) {}
+    size_t operator()(std::string_view key) const {return static_cast<size_t>(BytesHash::hash(key.data(), key.size(), seed_));}
+};
+
+template<>
+class SeededHash<std::string> : public SeededHash<std::string_view> {
+public:
+    using SeededHash<std::string_view>::SeededHash;
+};
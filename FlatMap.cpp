@@ -0,0 +1,643 @@
+#pragma once
+
+#include "FastHash.cpp"
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open-addressing table with the same interface as UnorderedMap.
+// Slots live in one contiguous array, next to it there is one control byte per slot:
+// empty, deleted, or the low 7 bits of the hash of the element stored in the slot.
+// Lookups scan the control bytes a group of 16 at a time.
+template<
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> > >
+class FlatMap {
+public:
+    using NodeType = std::pair<const Key, Value>;
+
+private:
+    static const int8_t emptyByte_ = -128;
+    static const int8_t deletedByte_ = -2;
+    static const int8_t sentinelByte_ = -1;
+    static const size_t groupWidth_ = 16;
+
+    class Group_ {
+    public:
+#ifdef __SSE2__
+        __m128i ctrl;
+        explicit Group_(const int8_t* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+        uint32_t match(int8_t h2) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+        }
+        uint32_t matchEmptyOrDeleted() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(sentinelByte_), ctrl)));
+        }
+#else
+        int8_t ctrl[groupWidth_];
+        explicit Group_(const int8_t* pos) {std::memcpy(ctrl, pos, groupWidth_);}
+        uint32_t match(int8_t h2) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth_; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+            }
+            return mask;
+        }
+        uint32_t matchEmptyOrDeleted() const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth_; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] < sentinelByte_) << i;
+            }
+            return mask;
+        }
+#endif
+        uint32_t matchEmpty() const {return match(emptyByte_);}
+    };
+
+    using ctrlAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<int8_t>;
+
+    int8_t* control_ = nullptr;
+    NodeType* slots_ = nullptr;
+    double maxLoadFactor_;
+    Hash hashFunction_;
+    Equal equalityFunction_;
+    Alloc alloc_;
+    ctrlAllocator ctrlAlloc_;
+    static constexpr double baseMaxLoadFactor_ = 0.875;
+    static const size_t resizeMultiply = 2;
+    size_t size_ = 0;
+    size_t deleted_ = 0;
+    size_t capacity_ = 0;
+
+    static size_t mix_(size_t h);
+    static size_t lowestBit_(uint32_t mask);
+    size_t groupCount_() const {return capacity_ / groupWidth_;}
+    size_t maxFill_() const {return static_cast<size_t>(static_cast<double>(capacity_) * maxLoadFactor_);}
+    size_t findIndex_(const Key& key, size_t hash) const;
+    size_t findInsertIndex_(size_t hash) const;
+    void setControl_(size_t index, int8_t h2) {control_[index] = h2;}
+    void allocateTable_(size_t capacity);
+    void deallocateTable_();
+    void destroyElements_();
+    void rehash_(size_t newCapacity);
+    void checkLoad_();
+    template<typename... Args>
+    size_t emplaceAt_(size_t hash, Args&& ...args);
+
+public:
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = NodeType;
+        using pointer = NodeType*;
+        using difference_type = size_t;
+        using reference = NodeType&;
+        int8_t* ctrl;
+        NodeType* slot;
+
+        iterator& operator++();
+        iterator operator++(int) {iterator it = *this; ++(*this); return it;}
+        iterator& operator+=(size_t k);
+        iterator operator+(size_t k) {iterator it = *this; return it += k;}
+        iterator& operator=(const iterator& it) {ctrl = it.ctrl; slot = it.slot; return *this;}
+        iterator(int8_t* c, NodeType* s) : ctrl(c), slot(s) {}
+        iterator(const iterator& other) : ctrl(other.ctrl), slot(other.slot) {}
+        value_type* operator->() {return slot;}
+        bool operator==(const iterator& other) {return ctrl == other.ctrl;}
+        bool operator!=(const iterator& other) {return !(*this == other);}
+        value_type& operator*() {return *slot;}
+        void skipEmpty();
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = const NodeType;
+        using pointer = value_type*;
+        using difference_type = size_t;
+        const int8_t* ctrl;
+        const NodeType* slot;
+
+        const_iterator& operator=(const const_iterator& it) {ctrl = it.ctrl; slot = it.slot; return *this;}
+        const_iterator& operator++();
+        const_iterator operator++(int) {const_iterator it = *this; ++(*this); return it;}
+        const_iterator& operator+=(size_t k);
+        const_iterator operator+(size_t k) {const_iterator it = *this; return it += k;}
+        const_iterator(const int8_t* c, const NodeType* s) : ctrl(c), slot(s) {}
+        const_iterator(const const_iterator& other) : ctrl(other.ctrl), slot(other.slot) {}
+        const_iterator(const iterator& other) : ctrl(other.ctrl), slot(other.slot) {}
+        bool operator==(const const_iterator& other) {return ctrl == other.ctrl;}
+        bool operator!=(const const_iterator& other) {return !(*this == other);}
+        value_type& operator*() {return *slot;}
+        const value_type* operator->() {return slot;}
+        void skipEmpty();
+    };
+
+    FlatMap();
+    FlatMap(const FlatMap& other);
+    FlatMap(FlatMap&& other);
+    FlatMap& operator=(const FlatMap& other);
+    FlatMap& operator=(FlatMap&& other);
+    ~FlatMap();
+    double load_factor() const;
+    iterator begin();
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    iterator end();
+    Value& operator[](const Key& key);
+    Value& at(const Key& key);
+    size_t capacity() const {return capacity_;}
+    size_t size() const {return size_;}
+    template<typename Iter>
+    void insert(Iter first, Iter second);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    std::pair<iterator, bool> insert(const NodeType& x);
+    template<typename U>
+    std::pair<iterator, bool> insert(U&& x);
+    void erase(iterator it);
+    void erase(iterator first, iterator second);
+    size_t erase(const Key& key);
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    void max_load_factor(double alpha);
+    void reserve(size_t count);
+
+};
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::mix_(size_t h) {
+    // std::hash of integers is the identity, so both the group index and the
+    // 7-bit tag would come straight from the key without this finalizer.
+    if constexpr (IsAvalanching<Hash>::value) {
+        return h;
+    }
+    uint64_t x = static_cast<uint64_t>(h);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::lowestBit_(uint32_t mask) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_ctz(mask));
+#else
+    size_t i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::iterator::skipEmpty() {
+    while (*ctrl < sentinelByte_) {
+        ++ctrl;
+        ++slot;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator::skipEmpty() {
+    while (*ctrl < sentinelByte_) {
+        ++ctrl;
+        ++slot;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator& FlatMap<Key, Value, Hash, Equal, Alloc>::iterator::operator++() {
+    ++ctrl;
+    ++slot;
+    skipEmpty();
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator& FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator::operator++() {
+    ++ctrl;
+    ++slot;
+    skipEmpty();
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator& FlatMap<Key, Value, Hash, Equal, Alloc>::iterator::operator+=(size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+        this->operator++();
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator& FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator::operator+=(size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+        this->operator++();
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>::FlatMap() {
+    maxLoadFactor_ = baseMaxLoadFactor_;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>::FlatMap(const FlatMap& other) :
+        maxLoadFactor_(other.maxLoadFactor_),
+        hashFunction_(other.hashFunction_),
+        equalityFunction_(other.equalityFunction_),
+        alloc_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.alloc_)) {
+    if (!other.size_) {
+        return;
+    }
+    allocateTable_(other.capacity_);
+    for (size_t i = 0; i < capacity_; ++i) {
+        if (other.control_[i] >= 0) {
+            std::allocator_traits<Alloc>::construct(alloc_, slots_ + i, other.slots_[i]);
+        }
+    }
+    // Tombstones are copied as well: probes for the copied elements may run through them.
+    std::memcpy(control_, other.control_, capacity_);
+    size_ = other.size_;
+    deleted_ = other.deleted_;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>::FlatMap(FlatMap&& other) :
+        control_(other.control_),
+        slots_(other.slots_),
+        maxLoadFactor_(other.maxLoadFactor_),
+        hashFunction_(std::move(other.hashFunction_)),
+        equalityFunction_(std::move(other.equalityFunction_)),
+        alloc_(std::move(other.alloc_)),
+        ctrlAlloc_(std::move(other.ctrlAlloc_)),
+        size_(other.size_),
+        deleted_(other.deleted_),
+        capacity_(other.capacity_) {
+    other.control_ = nullptr;
+    other.slots_ = nullptr;
+    other.size_ = 0;
+    other.deleted_ = 0;
+    other.capacity_ = 0;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>& FlatMap<Key, Value, Hash, Equal, Alloc>::operator=(const FlatMap<Key, Value, Hash, Equal, Alloc>& other) {
+    if (this == &other) {
+        return *this;
+    }
+    FlatMap copy(other);
+    *this = std::move(copy);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>& FlatMap<Key, Value, Hash, Equal, Alloc>::operator=(FlatMap<Key, Value, Hash, Equal, Alloc>&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    destroyElements_();
+    deallocateTable_();
+    control_ = other.control_;
+    slots_ = other.slots_;
+    maxLoadFactor_ = other.maxLoadFactor_;
+    hashFunction_ = std::move(other.hashFunction_);
+    equalityFunction_ = std::move(other.equalityFunction_);
+    alloc_ = std::move(other.alloc_);
+    ctrlAlloc_ = std::move(other.ctrlAlloc_);
+    size_ = other.size_;
+    deleted_ = other.deleted_;
+    capacity_ = other.capacity_;
+    other.control_ = nullptr;
+    other.slots_ = nullptr;
+    other.size_ = 0;
+    other.deleted_ = 0;
+    other.capacity_ = 0;
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+FlatMap<Key, Value, Hash, Equal, Alloc>::~FlatMap() {
+    destroyElements_();
+    deallocateTable_();
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::allocateTable_(size_t capacity) {
+    capacity_ = capacity;
+    control_ = std::allocator_traits<ctrlAllocator>::allocate(ctrlAlloc_, capacity_ + 1);
+    std::memset(control_, emptyByte_, capacity_);
+    control_[capacity_] = sentinelByte_;
+    slots_ = std::allocator_traits<Alloc>::allocate(alloc_, capacity_);
+    size_ = 0;
+    deleted_ = 0;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::deallocateTable_() {
+    if (!capacity_) {
+        return;
+    }
+    std::allocator_traits<ctrlAllocator>::deallocate(ctrlAlloc_, control_, capacity_ + 1);
+    std::allocator_traits<Alloc>::deallocate(alloc_, slots_, capacity_);
+    control_ = nullptr;
+    slots_ = nullptr;
+    capacity_ = 0;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::destroyElements_() {
+    for (size_t i = 0; i < capacity_ && size_; ++i) {
+        if (control_[i] >= 0) {
+            std::allocator_traits<Alloc>::destroy(alloc_, slots_ + i);
+            control_[i] = emptyByte_;
+            --size_;
+        }
+    }
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::findIndex_(const Key& key, size_t hash) const {
+    if (!capacity_) {
+        return capacity_;
+    }
+    int8_t h2 = static_cast<int8_t>(hash & 0x7F);
+    size_t mask = groupCount_() - 1;
+    size_t group = (hash >> 7) & mask;
+
+    for (size_t step = 1; ; ++step) {
+        size_t base = group * groupWidth_;
+        Group_ g(control_ + base);
+        for (uint32_t m = g.match(h2); m; m &= m - 1) {
+            size_t index = base + lowestBit_(m);
+            if (equalityFunction_(slots_[index].first, key)) {
+                return index;
+            }
+        }
+        if (g.matchEmpty()) {
+            return capacity_;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::findInsertIndex_(size_t hash) const {
+    size_t mask = groupCount_() - 1;
+    size_t group = (hash >> 7) & mask;
+
+    for (size_t step = 1; ; ++step) {
+        size_t base = group * groupWidth_;
+        uint32_t m = Group_(control_ + base).matchEmptyOrDeleted();
+        if (m) {
+            return base + lowestBit_(m);
+        }
+        group = (group + step) & mask;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename... Args>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::emplaceAt_(size_t hash, Args&& ...args) {
+    size_t index = findInsertIndex_(hash);
+    std::allocator_traits<Alloc>::construct(alloc_, slots_ + index, std::forward<Args>(args)...);
+    if (control_[index] == deletedByte_) {
+        --deleted_;
+    }
+    setControl_(index, static_cast<int8_t>(hash & 0x7F));
+    ++size_;
+    return index;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::rehash_(size_t newCapacity) {
+    if (newCapacity < groupWidth_) {
+        newCapacity = groupWidth_;
+    }
+
+    int8_t* oldControl = control_;
+    NodeType* oldSlots = slots_;
+    size_t oldCapacity = capacity_;
+    allocateTable_(newCapacity);
+
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (oldControl[i] >= 0) {
+            emplaceAt_(mix_(hashFunction_(oldSlots[i].first)), std::move(oldSlots[i]));
+            std::allocator_traits<Alloc>::destroy(alloc_, oldSlots + i);
+        }
+    }
+
+    if (oldCapacity) {
+        std::allocator_traits<ctrlAllocator>::deallocate(ctrlAlloc_, oldControl, oldCapacity + 1);
+        std::allocator_traits<Alloc>::deallocate(alloc_, oldSlots, oldCapacity);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::checkLoad_() {
+    if (size_ + deleted_ < maxFill_()) {
+        return;
+    }
+    // Tombstones alone can fill the table; then rebuilding at the same size is enough.
+    if (size_ * 2 < maxFill_()) {
+        rehash_(capacity_);
+    } else {
+        rehash_(capacity_ ? capacity_ * resizeMultiply : groupWidth_);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+double FlatMap<Key, Value, Hash, Equal, Alloc>::load_factor() const {
+    if (!capacity_) {
+        return 0.0;
+    }
+    double x = static_cast<double>(size_);
+    double y = static_cast<double>(capacity_);
+    return x / y;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::max_load_factor(double alpha) {
+    // A probe only stops at a group with an empty byte, so the table can never be full.
+    if (alpha > 0.9375) {
+        alpha = 0.9375;
+    }
+    maxLoadFactor_ = alpha;
+    if (capacity_ && size_ + deleted_ >= maxFill_()) {
+        reserve(size_);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::reserve(size_t count) {
+    size_t newCapacity = groupWidth_;
+    while (static_cast<size_t>(static_cast<double>(newCapacity) * maxLoadFactor_) <= count) {
+        newCapacity *= resizeMultiply;
+    }
+    if (newCapacity > capacity_) {
+        rehash_(newCapacity);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator FlatMap<Key, Value, Hash, Equal, Alloc>::begin() {
+    if (!capacity_) {
+        return end();
+    }
+    iterator it(control_, slots_);
+    it.skipEmpty();
+    return it;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator FlatMap<Key, Value, Hash, Equal, Alloc>::cbegin() const {
+    if (!capacity_) {
+        return cend();
+    }
+    const_iterator it(control_, slots_);
+    it.skipEmpty();
+    return it;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator FlatMap<Key, Value, Hash, Equal, Alloc>::cend() const {
+    return const_iterator(control_ + capacity_, slots_ + capacity_);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator FlatMap<Key, Value, Hash, Equal, Alloc>::end() {
+    return iterator(control_ + capacity_, slots_ + capacity_);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator FlatMap<Key, Value, Hash, Equal, Alloc>::find(const Key& key) {
+    size_t index = findIndex_(key, mix_(hashFunction_(key)));
+    return iterator(control_ + index, slots_ + index);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+typename FlatMap<Key, Value, Hash, Equal, Alloc>::const_iterator FlatMap<Key, Value, Hash, Equal, Alloc>::find(const Key& key) const {
+    size_t index = findIndex_(key, mix_(hashFunction_(key)));
+    return const_iterator(control_ + index, slots_ + index);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+std::pair<typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> FlatMap<Key, Value, Hash, Equal, Alloc>::insert(const NodeType& x) {
+    size_t hash = mix_(hashFunction_(x.first));
+    size_t index = findIndex_(x.first, hash);
+    if (index != capacity_) {
+        return {iterator(control_ + index, slots_ + index), false};
+    }
+
+    checkLoad_();
+    index = emplaceAt_(hash, x);
+    return {iterator(control_ + index, slots_ + index), true};
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename U>
+std::pair<typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> FlatMap<Key, Value, Hash, Equal, Alloc>::insert(U&& x) {
+    size_t hash = mix_(hashFunction_(x.first));
+    size_t index = findIndex_(x.first, hash);
+    if (index != capacity_) {
+        return {iterator(control_ + index, slots_ + index), false};
+    }
+
+    checkLoad_();
+    index = emplaceAt_(hash, std::forward<U>(x));
+    return {iterator(control_ + index, slots_ + index), true};
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename Iter>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::insert(Iter first, Iter second) {
+    for (Iter it = first; it != second; ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename... Args>
+std::pair<typename FlatMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> FlatMap<Key, Value, Hash, Equal, Alloc>::emplace(Args&&... args) {
+    NodeType x(std::forward<Args>(args)...);
+    return insert(std::move(x));
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+Value& FlatMap<Key, Value, Hash, Equal, Alloc>::operator[](const Key& key) {
+    size_t hash = mix_(hashFunction_(key));
+    size_t index = findIndex_(key, hash);
+    if (index != capacity_) {
+        return slots_[index].second;
+    }
+
+    checkLoad_();
+    index = emplaceAt_(hash, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+    return slots_[index].second;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+Value& FlatMap<Key, Value, Hash, Equal, Alloc>::at(const Key& key) {
+    iterator it = find(key);
+
+    if (it == end()) {
+        throw std::out_of_range("No Key");
+    }
+
+    return (*it).second;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::erase(iterator it) {
+    size_t index = static_cast<size_t>(it.ctrl - control_);
+    std::allocator_traits<Alloc>::destroy(alloc_, slots_ + index);
+    --size_;
+
+    // If the group still has an empty byte no probe has ever passed through it,
+    // so the slot can become empty instead of a tombstone.
+    size_t base = index - index % groupWidth_;
+    if (Group_(control_ + base).matchEmpty()) {
+        setControl_(index, emptyByte_);
+    } else {
+        setControl_(index, deletedByte_);
+        ++deleted_;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+void FlatMap<Key, Value, Hash, Equal, Alloc>::erase(iterator first, iterator second) {
+    while (first != second) {
+        iterator current = first++;
+        erase(current);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+size_t FlatMap<Key, Value, Hash, Equal, Alloc>::erase(const Key& key) {
+    iterator it = find(key);
+    if (it == end()) {
+        return 0;
+    }
+    erase(it);
+    return 1;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <utility>
+#include <functional>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+constexpr uint64_t frozenMix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Seeded hashes usable in constant expressions, std::hash is not.
+template<typename T, typename = void>
+class FrozenHash;
+
+template<typename T>
+class FrozenHash<T, std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> > {
+public:
+    constexpr uint64_t operator()(T key, uint64_t seed) const {
+        return frozenMix(static_cast<uint64_t>(key) ^ seed);
+    }
+};
+
+template<>
+class FrozenHash<std::string_view> {
+public:
+    constexpr uint64_t operator()(std::string_view key, uint64_t seed) const {
+        uint64_t x = 0xCBF29CE484222325ULL ^ seed;
+        for (char c : key) {
+            x = (x ^ static_cast<uint8_t>(c)) * 0x100000001B3ULL;
+        }
+        return frozenMix(x);
+    }
+};
+
+// Immutable map built entirely at compile time from a literal list of pairs, see makeFrozenMap.
+// The keys get a perfect hash by hash-and-displace: a key falls into a bucket by its hash,
+// every bucket has a pilot chosen so that hash and pilot send its keys to slots no other key uses.
+// A lookup hashes the key once, reads the pilot and the slot and compares one key.
+// Elements are kept and iterated in the order they were listed.
+template<
+    typename Key,
+    typename Value,
+    size_t N,
+    typename Hash = FrozenHash<Key>,
+    typename Equal = std::equal_to<Key> >
+class FrozenMap {
+    static_assert(N > 0, "FrozenMap needs at least one element");
+
+public:
+    using NodeType = std::pair<Key, Value>;
+    using value_type = NodeType;
+    using const_iterator = const NodeType*;
+    using iterator = const_iterator;
+
+private:
+    static constexpr size_t powerOfTwo_(size_t atLeast) {
+        size_t count = 1;
+        while (count < atLeast) {
+            count <<= 1;
+        }
+        return count;
+    }
+
+    static constexpr size_t slotCount_ = powerOfTwo_(N);
+    static constexpr size_t bucketCount_ = powerOfTwo_((N + 1) / 2);
+    static constexpr uint32_t maxPilot_ = 1u << 20;
+    static constexpr uint64_t maxSeeds_ = 16;
+    using Index_ = std::conditional_t<(N < UINT16_MAX), uint16_t, uint32_t>;
+
+    std::array<NodeType, N> elements_;
+    std::array<uint32_t, bucketCount_> pilots_{};
+    std::array<Index_, slotCount_> slots_{};
+    uint64_t seed_ = 0;
+    Hash hashFunction_{};
+    Equal equalityFunction_{};
+
+    template<size_t... I>
+    static constexpr std::array<NodeType, N> copy_(const NodeType (&elements)[N], std::index_sequence<I...>) {
+        return {{elements[I]...}};
+    }
+
+    static constexpr size_t bucket_(uint64_t hash) {return static_cast<size_t>(hash >> 32) & (bucketCount_ - 1);}
+    static constexpr size_t slot_(uint64_t hash, uint32_t pilot) {
+        return static_cast<size_t>(frozenMix(hash ^ (pilot * 0x9E3779B97F4A7C15ULL))) & (slotCount_ - 1);
+    }
+
+    constexpr bool build_();
+
+public:
+    constexpr explicit FrozenMap(const NodeType (&elements)[N], const Hash& hash = Hash(), const Equal& equal = Equal())
+        : elements_(copy_(elements, std::make_index_sequence<N>())), hashFunction_(hash), equalityFunction_(equal) {
+        while (!build_()) {
+            if (++seed_ == maxSeeds_) {
+                throw std::logic_error("FrozenMap found no perfect hash");
+            }
+        }
+    }
+
+    constexpr size_t size() const {return N;}
+    constexpr bool empty() const {return false;}
+
+    constexpr const_iterator begin() const {return elements_.data();}
+    constexpr const_iterator end() const {return elements_.data() + N;}
+    constexpr const_iterator cbegin() const {return begin();}
+    constexpr const_iterator cend() const {return end();}
+
+    constexpr const_iterator find(const Key& key) const {
+        uint64_t hash = hashFunction_(key, seed_);
+        Index_ index = slots_[slot_(hash, pilots_[bucket_(hash)])];
+        return index < N && equalityFunction_(elements_[index].first, key) ? begin() + index : end();
+    }
+
+    constexpr bool contains(const Key& key) const {return find(key) != end();}
+    constexpr size_t count(const Key& key) const {return contains(key);}
+
+    constexpr const Value& at(const Key& key) const {
+        const_iterator it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("No Key");
+        }
+        return it->second;
+    }
+};
+
+// Places the buckets, largest first, with the current seed. Fails if two different keys
+// share the whole 64-bit hash or some bucket gets no pilot.
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal>
+constexpr bool FrozenMap<Key, Value, N, Hash, Equal>::build_() {
+    std::array<uint64_t, N> hashes{};
+    std::array<size_t, bucketCount_ + 1> starts{};
+    for (size_t i = 0; i < N; ++i) {
+        hashes[i] = hashFunction_(elements_[i].first, seed_);
+        ++starts[bucket_(hashes[i]) + 1];
+    }
+    size_t largest = 0;
+    for (size_t b = 0; b < bucketCount_; ++b) {
+        largest = starts[b + 1] > largest ? starts[b + 1] : largest;
+        starts[b + 1] += starts[b];
+    }
+    std::array<size_t, N> members{};
+    std::array<size_t, bucketCount_> filled{};
+    for (size_t i = 0; i < N; ++i) {
+        size_t b = bucket_(hashes[i]);
+        members[starts[b] + filled[b]++] = i;
+    }
+
+    for (size_t s = 0; s < slotCount_; ++s) {
+        slots_[s] = static_cast<Index_>(N);
+    }
+    for (size_t b = 0; b < bucketCount_; ++b) {
+        pilots_[b] = 0;
+    }
+
+    std::array<size_t, N> placed{};
+    for (size_t length = largest; length > 0; --length) {
+        for (size_t b = 0; b < bucketCount_; ++b) {
+            if (starts[b + 1] - starts[b] != length) {
+                continue;
+            }
+
+            // Keys with the same full hash collide for every pilot.
+            for (size_t j = 0; j < length; ++j) {
+                for (size_t k = 0; k < j; ++k) {
+                    size_t x = members[starts[b] + j];
+                    size_t y = members[starts[b] + k];
+                    if (hashes[x] != hashes[y]) {
+                        continue;
+                    }
+                    if (equalityFunction_(elements_[x].first, elements_[y].first)) {
+                        throw std::logic_error("FrozenMap has a duplicate key");
+                    }
+                    return false;
+                }
+            }
+
+            uint32_t pilot = 0;
+            for (; pilot < maxPilot_; ++pilot) {
+                bool fits = true;
+                for (size_t j = 0; j < length && fits; ++j) {
+                    placed[j] = slot_(hashes[members[starts[b] + j]], pilot);
+                    fits = slots_[placed[j]] == N;
+                    for (size_t k = 0; k < j && fits; ++k) {
+                        fits = placed[k] != placed[j];
+                    }
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            if (pilot == maxPilot_) {
+                return false;
+            }
+
+            pilots_[b] = pilot;
+            for (size_t j = 0; j < length; ++j) {
+                slots_[placed[j]] = static_cast<Index_>(members[starts[b] + j]);
+            }
+        }
+    }
+    return true;
+}
+
+// constexpr auto commands = makeFrozenMap<std::string_view, int>({{"get", 1}, {"set", 2}});
+template<typename Key, typename Value, size_t N>
+constexpr FrozenMap<Key, Value, N> makeFrozenMap(const std::pair<Key, Value> (&elements)[N]) {
+    return FrozenMap<Key, Value, N>(elements);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define HASH_HAS_COROUTINES 1
+#endif
+
+// Tools for hiding memory latency of pointer-chasing lookups.
+
+inline void prefetchRead(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#else
+    (void)address;
+#endif
+}
+
+#ifdef HASH_HAS_COROUTINES
+
+// A lookup written as a coroutine that suspends right after prefetching whatever it is
+// about to dereference. Several of them are resumed round robin by runInterleaved, so
+// while one waits for its cache line the others make progress (AMAC-style interleaving).
+class InterleavedTask {
+public:
+    class promise_type {
+    public:
+        std::exception_ptr exception;
+
+        InterleavedTask get_return_object() {
+            return InterleavedTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_always final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {exception = std::current_exception();}
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+public:
+    explicit InterleavedTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    InterleavedTask(const InterleavedTask& other) = delete;
+    InterleavedTask(InterleavedTask&& other) : handle_(other.handle_) {other.handle_ = nullptr;}
+    InterleavedTask& operator=(const InterleavedTask& other) = delete;
+    InterleavedTask& operator=(InterleavedTask&& other) {std::swap(handle_, other.handle_); return *this;}
+    ~InterleavedTask() {if (handle_) {handle_.destroy();}}
+
+    // Runs the task up to its next suspension, returns whether it has more work.
+    bool resume() {
+        handle_.resume();
+        if (handle_.promise().exception) {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+        return !handle_.done();
+    }
+};
+
+// co_await PrefetchAndSuspend(p) issues the prefetch and yields to the next task.
+class PrefetchAndSuspend {
+public:
+    explicit PrefetchAndSuspend(const void* address) {prefetchRead(address);}
+    bool await_ready() const noexcept {return false;}
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
+};
+
+// Starts group tasks made by makeTask() and resumes them in turn until all have finished.
+// Each task is expected to keep taking work from a shared queue, so only group frames are
+// allocated however long the input is.
+template<typename MakeTask>
+void runInterleaved(size_t group, MakeTask&& makeTask) {
+    std::vector<InterleavedTask> tasks;
+    tasks.reserve(group);
+    for (size_t i = 0; i < group; ++i) {
+        tasks.push_back(makeTask());
+    }
+
+    size_t alive = tasks.size();
+    while (alive) {
+        for (size_t i = 0; i < alive;) {
+            if (tasks[i].resume()) {
+                ++i;
+            } else {
+                --alive;
+                std::swap(tasks[i], tasks[alive]);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "UnMap.cpp"
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+// Buffers what is written and hands it to the stream in chunks of about chunkSize bytes.
+// A record is written between beginRecord() and endRecord() and is prefixed by its length,
+// it always stays in the buffer as a whole, which grows if a record is larger than a chunk.
+class StreamWriter {
+private:
+    std::ostream& out_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+    size_t chunkSize_;
+    size_t recordStart_ = 0;
+
+    char* reserve_(size_t bytes) {
+        if (buffer_.size() < used_ + bytes) {
+            buffer_.resize(std::max(buffer_.size() * 2, used_ + bytes));
+        }
+        char* answer = buffer_.data() + used_;
+        used_ += bytes;
+        return answer;
+    }
+
+public:
+    explicit StreamWriter(std::ostream& out, size_t chunkSize = 1 << 16) : out_(out), buffer_(chunkSize), chunkSize_(chunkSize) {}
+    StreamWriter(const StreamWriter&) = delete;
+    StreamWriter& operator=(const StreamWriter&) = delete;
+    ~StreamWriter() {
+        if (used_) {
+            out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        }
+    }
+
+    void write(const void* data, size_t bytes) {std::memcpy(reserve_(bytes), data, bytes);}
+
+    void writeVarint(uint64_t x) {
+        char* pos = reserve_(10);
+        size_t length = 0;
+        while (x >= 0x80) {
+            pos[length++] = static_cast<char>(x | 0x80);
+            x >>= 7;
+        }
+        pos[length++] = static_cast<char>(x);
+        used_ -= 10 - length;
+    }
+
+    void beginRecord() {
+        recordStart_ = used_;
+        reserve_(sizeof(uint32_t));
+    }
+
+    void endRecord() {
+        size_t length = used_ - recordStart_ - sizeof(uint32_t);
+        if (length > UINT32_MAX) {
+            throw std::length_error("Record is too large");
+        }
+        uint32_t prefix = static_cast<uint32_t>(length);
+        std::memcpy(buffer_.data() + recordStart_, &prefix, sizeof(prefix));
+        if (used_ >= chunkSize_) {
+            flush();
+        }
+    }
+
+    void flush() {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+        if (!out_) {
+            throw std::runtime_error("Map stream write failed");
+        }
+    }
+};
+
+// Reads the bytes of one record, the pointers it returns stay valid until the next record is read.
+class RecordReader {
+private:
+    const char* pos_;
+    const char* end_;
+
+public:
+    RecordReader(const char* data, size_t bytes) : pos_(data), end_(data + bytes) {}
+
+    const char* take(size_t bytes) {
+        if (static_cast<size_t>(end_ - pos_) < bytes) {
+            throw std::runtime_error("Map stream record is truncated");
+        }
+        const char* answer = pos_;
+        pos_ += bytes;
+        return answer;
+    }
+
+    uint64_t readVarint() {
+        uint64_t answer = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(*take(1));
+            answer |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return answer;
+            }
+        }
+        throw std::runtime_error("Map stream varint is too long");
+    }
+
+    bool done() const {return pos_ == end_;}
+};
+
+// Reads the stream in chunks of chunkSize bytes. It reads ahead, so after a map the rest
+// of the stream has to be read through the same StreamReader. A record longer than maxRecord
+// bytes is a format error, and the buffer only grows as far as the stream really has bytes.
+class StreamReader {
+private:
+    std::istream& in_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    size_t maxRecord_;
+
+public:
+    explicit StreamReader(std::istream& in, size_t chunkSize = 1 << 16, size_t maxRecord = 1 << 28)
+        : in_(in), buffer_(chunkSize), maxRecord_(maxRecord) {}
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    const char* take(size_t bytes);
+    void read(void* data, size_t bytes) {std::memcpy(data, take(bytes), bytes);}
+
+    RecordReader record() {
+        uint32_t length;
+        read(&length, sizeof(length));
+        if (length > maxRecord_) {
+            throw std::runtime_error("Map stream record is too large");
+        }
+        return RecordReader(take(length), length);
+    }
+};
+
+inline const char* StreamReader::take(size_t bytes) {
+    if (end_ - begin_ < bytes) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        while (end_ < bytes) {
+            if (end_ == buffer_.size()) {
+                buffer_.resize(std::min(bytes, std::max<size_t>(buffer_.size() * 2, 1)));
+            }
+            std::streamsize got = in_.rdbuf()->sgetn(buffer_.data() + end_, static_cast<std::streamsize>(buffer_.size() - end_));
+            if (got <= 0) {
+                throw std::runtime_error("Unexpected end of map stream");
+            }
+            end_ += static_cast<size_t>(got);
+        }
+    }
+
+    const char* answer = buffer_.data() + begin_;
+    begin_ += bytes;
+    return answer;
+}
+
+// How a key or a value travels through a stream. encode writes it, decode returns the tuple of
+// constructor arguments it is rebuilt from, which may point into the record being read.
+// Specialize Codec or pass other codecs to MapStream for own types.
+template<typename T, typename = void>
+class Codec;
+
+template<typename T>
+class Codec<T, std::enable_if_t<std::is_trivially_copyable<T>::value> > {
+public:
+    static void encode(const T& value, StreamWriter& out) {out.write(&value, sizeof(T));}
+
+    static std::tuple<T> decode(RecordReader& in) {
+        T value;
+        std::memcpy(&value, in.take(sizeof(T)), sizeof(T));
+        return std::tuple<T>(value);
+    }
+};
+
+template<>
+class Codec<std::string> {
+public:
+    static void encode(const std::string& value, StreamWriter& out) {
+        out.writeVarint(value.size());
+        out.write(value.data(), value.size());
+    }
+
+    static std::tuple<const char*, size_t> decode(RecordReader& in) {
+        size_t length = static_cast<size_t>(in.readVarint());
+        return std::tuple<const char*, size_t>(in.take(length), length);
+    }
+};
+
+// Stream format: header with the element count, then one length-prefixed record per element
+// holding the encoded key and value. Numbers are in the byte order of the writer, the header
+// lets a reader on another one fail instead of misreading.
+template<typename Key, typename Value, typename KeyCodec = Codec<Key>, typename ValueCodec = Codec<Value> >
+class MapStream {
+private:
+    class Header_ {
+    public:
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t count;
+    };
+
+    static constexpr char expectedMagic_[8] = {'H', 'M', 'A', 'P', 'S', 'T', 'R', 'M'};
+    static const uint32_t currentVersion_ = 1;
+    static const uint32_t byteOrderMark_ = 0x01020304;
+
+public:
+    // Writes any map of Key to Value with cbegin(), cend() and size().
+    template<typename Map>
+    static void write(StreamWriter& out, const Map& map);
+    template<typename Map>
+    static void write(std::ostream& out, const Map& map) {
+        StreamWriter writer(out);
+        write(writer, map);
+        writer.flush();
+    }
+
+    // Adds the elements of the stream to map. The count is known before the first element,
+    // so the buckets are reserved once (for at most 1M elements, the count is not trusted
+    // further) and every node is built straight from the read buffer.
+    template<typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+    static void read(StreamReader& in, UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>& map);
+    template<typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+    static void read(std::istream& in, UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>& map) {
+        StreamReader reader(in);
+        read(reader, map);
+    }
+};
+
+template<typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+template<typename Map>
+void MapStream<Key, Value, KeyCodec, ValueCodec>::write(StreamWriter& out, const Map& map) {
+    Header_ header;
+    std::memcpy(header.magic, expectedMagic_, sizeof(header.magic));
+    header.version = currentVersion_;
+    header.byteOrder = byteOrderMark_;
+    header.count = map.size();
+    out.write(&header, sizeof(header));
+
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        out.beginRecord();
+        KeyCodec::encode((*it).first, out);
+        ValueCodec::encode((*it).second, out);
+        out.endRecord();
+    }
+}
+
+template<typename Key, typename Value, typename KeyCodec, typename ValueCodec>
+template<typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void MapStream<Key, Value, KeyCodec, ValueCodec>::read(StreamReader& in, UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>& map) {
+    Header_ header;
+    in.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, expectedMagic_, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a map stream");
+    }
+    if (header.version != currentVersion_ || header.byteOrder != byteOrderMark_) {
+        throw std::runtime_error("Unsupported map stream version or byte order");
+    }
+
+    map.emplace_n(static_cast<size_t>(header.count), [&in](auto&& construct) {
+        RecordReader record = in.record();
+        auto key = KeyCodec::decode(record);
+        auto value = ValueCodec::decode(record);
+        if (!record.done()) {
+            throw std::runtime_error("Map stream record has trailing bytes");
+        }
+        construct(std::piecewise_construct, std::move(key), std::move(value));
+    });
+}
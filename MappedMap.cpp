@@ -0,0 +1,328 @@
+#pragma once
+
+#include "UnMap.cpp"
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Element of a snapshot. Unlike std::pair it is trivially copyable, so it can live in a file.
+template<typename Key, typename Value>
+class SnapshotEntry {
+public:
+    Key first;
+    Value second;
+};
+
+// File layout, every part aligned to 64 bytes:
+//   header | bucketCount + 1 offsets of the bucket starts | size hashes | size entries.
+// Entries are grouped by bucket, a bucket is found by the same BucketPolicy that wrote the file.
+class SnapshotHeader {
+public:
+    static constexpr char expectedMagic[8] = {'H', 'M', 'A', 'P', 'S', 'N', 'A', 'P'};
+    static const uint32_t currentVersion = 1;
+    static const uint32_t byteOrderMark = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t keySize;
+    uint64_t valueSize;
+    uint64_t entrySize;
+    uint64_t entryAlign;
+    uint64_t size;
+    uint64_t bucketCount;
+    uint64_t bucketsOffset;
+    uint64_t hashesOffset;
+    uint64_t entriesOffset;
+    uint64_t fileSize;
+};
+
+// Read-only map opened straight from a snapshot file with mmap: find, at and iteration work on
+// the mapped pages, nothing is read before it is needed and the page cache is shared between processes.
+// Hash must give the same values in the process that saves and in the ones that open the file,
+// so hashes seeded per process do not fit.
+template<
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename BucketPolicy = DefaultBuckets<Hash> >
+class MappedMap {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedMap stores keys and values as raw bytes");
+
+public:
+    using NodeType = SnapshotEntry<Key, Value>;
+    using value_type = NodeType;
+    using const_iterator = const NodeType*;
+    using iterator = const_iterator;
+
+private:
+    static const size_t partAlign_ = 64;
+
+    void* base_ = nullptr;
+    size_t length_ = 0;
+    size_t size_ = 0;
+    size_t bucketCount_ = 0;
+    const uint64_t* buckets_ = nullptr;
+    const uint64_t* hashes_ = nullptr;
+    const NodeType* entries_ = nullptr;
+    BucketPolicy bucketPolicy_;
+    Hash hashFunction_;
+    Equal equalityFunction_;
+
+    static size_t alignUp_(size_t offset) {return (offset + partAlign_ - 1) / partAlign_ * partAlign_;}
+    static SnapshotHeader layout_(size_t size, size_t bucketCount);
+    void check_(const SnapshotHeader& header, size_t fileSize) const;
+    void release_();
+
+public:
+    explicit MappedMap(const std::string& path, const Hash& hash = Hash(), const Equal& equal = Equal());
+    MappedMap(MappedMap&& other);
+    MappedMap& operator=(MappedMap&& other);
+    MappedMap(const MappedMap&) = delete;
+    MappedMap& operator=(const MappedMap&) = delete;
+    ~MappedMap() {release_();}
+
+    // Writes any map of Key to Value with cbegin(), cend() and size() as a snapshot.
+    // The file is written under a temporary name and renamed, so readers never see half of it.
+    template<typename Map>
+    static void save(const Map& map, const std::string& path, const Hash& hash = Hash());
+
+    size_t size() const {return size_;}
+    bool empty() const {return size_ == 0;}
+    size_t bucket_count() const {return bucketCount_;}
+
+    const_iterator begin() const {return entries_;}
+    const_iterator end() const {return entries_ + size_;}
+    const_iterator cbegin() const {return begin();}
+    const_iterator cend() const {return end();}
+
+    const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const {return find(key) != end();}
+    size_t count(const Key& key) const {return contains(key);}
+    const Value& at(const Key& key) const;
+};
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+SnapshotHeader MappedMap<Key, Value, Hash, Equal, BucketPolicy>::layout_(size_t size, size_t bucketCount) {
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SnapshotHeader::expectedMagic, sizeof(header.magic));
+    header.version = SnapshotHeader::currentVersion;
+    header.byteOrder = SnapshotHeader::byteOrderMark;
+    header.keySize = sizeof(Key);
+    header.valueSize = sizeof(Value);
+    header.entrySize = sizeof(NodeType);
+    header.entryAlign = alignof(NodeType);
+    header.size = size;
+    header.bucketCount = bucketCount;
+    header.bucketsOffset = alignUp_(sizeof(SnapshotHeader));
+    header.hashesOffset = alignUp_(header.bucketsOffset + (bucketCount + 1) * sizeof(uint64_t));
+    header.entriesOffset = alignUp_(header.hashesOffset + size * sizeof(uint64_t));
+    header.fileSize = header.entriesOffset + size * sizeof(NodeType);
+    return header;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+template<typename Map>
+void MappedMap<Key, Value, Hash, Equal, BucketPolicy>::save(const Map& map, const std::string& path, const Hash& hash) {
+    static_assert(alignof(NodeType) <= partAlign_, "entry alignment is larger than the file parts are aligned to");
+
+    BucketPolicy policy;
+    size_t bucketCount = policy.reset(map.size() ? map.size() : 1);
+    SnapshotHeader header = layout_(map.size(), bucketCount);
+
+    // The buckets of the elements in iteration order, then counting sort by bucket straight into the file.
+    std::vector<uint64_t> hashes;
+    hashes.reserve(map.size());
+    std::vector<uint64_t> starts(bucketCount + 1, 0);
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        hashes.push_back(static_cast<uint64_t>(hash((*it).first)));
+        ++starts[policy.index(static_cast<size_t>(hashes.back())) + 1];
+    }
+    if (hashes.size() != map.size()) {
+        throw std::logic_error("Map size does not match its elements");
+    }
+    for (size_t i = 0; i < bucketCount; ++i) {
+        starts[i + 1] += starts[i];
+    }
+
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + temporary);
+    }
+    void* base = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(header.fileSize)) == 0) {
+        base = ::mmap(nullptr, header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::remove(temporary.c_str());
+        throw std::system_error(error, std::generic_category(), "write " + temporary);
+    }
+
+    char* bytes = static_cast<char*>(base);
+    std::memcpy(bytes, &header, sizeof(header));
+    std::memcpy(bytes + header.bucketsOffset, starts.data(), starts.size() * sizeof(uint64_t));
+    uint64_t* fileHashes = reinterpret_cast<uint64_t*>(bytes + header.hashesOffset);
+    NodeType* fileEntries = reinterpret_cast<NodeType*>(bytes + header.entriesOffset);
+    size_t i = 0;
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        uint64_t position = starts[policy.index(static_cast<size_t>(hashes[i]))]++;
+        fileHashes[position] = hashes[i];
+        NodeType entry{(*it).first, (*it).second};
+        std::memcpy(fileEntries + position, &entry, sizeof(NodeType));
+        ++i;
+    }
+
+    error = ::msync(base, header.fileSize, MS_SYNC) != 0 ? errno : 0;
+    ::munmap(base, header.fileSize);
+    if (!error && std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = errno;
+    }
+    if (error) {
+        std::remove(temporary.c_str());
+        throw std::system_error(error, std::generic_category(), "write " + path);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+void MappedMap<Key, Value, Hash, Equal, BucketPolicy>::check_(const SnapshotHeader& header, size_t fileSize) const {
+    if (std::memcmp(header.magic, SnapshotHeader::expectedMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a map snapshot");
+    }
+    if (header.version != SnapshotHeader::currentVersion || header.byteOrder != SnapshotHeader::byteOrderMark) {
+        throw std::runtime_error("Unsupported snapshot version or byte order");
+    }
+    if (header.keySize != sizeof(Key) || header.valueSize != sizeof(Value) ||
+        header.entrySize != sizeof(NodeType) || header.entryAlign != alignof(NodeType)) {
+        throw std::runtime_error("Snapshot was written for other key or value types");
+    }
+    // Counts that cannot fit in the file are rejected first: layout_ would wrap around on them.
+    uint64_t body = fileSize > alignUp_(sizeof(SnapshotHeader)) ? fileSize - alignUp_(sizeof(SnapshotHeader)) : 0;
+    if (header.bucketCount >= body / sizeof(uint64_t) || header.size > body / (sizeof(uint64_t) + sizeof(NodeType))) {
+        throw std::runtime_error("Snapshot is truncated or has another bucket layout");
+    }
+    SnapshotHeader expected = layout_(header.size, header.bucketCount);
+    BucketPolicy policy;
+    if (header.fileSize != fileSize || expected.fileSize != fileSize ||
+        expected.bucketsOffset != header.bucketsOffset || expected.hashesOffset != header.hashesOffset ||
+        expected.entriesOffset != header.entriesOffset || policy.reset(header.bucketCount) != header.bucketCount) {
+        throw std::runtime_error("Snapshot is truncated or has another bucket layout");
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+MappedMap<Key, Value, Hash, Equal, BucketPolicy>::MappedMap(const std::string& path, const Hash& hash, const Equal& equal)
+    : hashFunction_(hash), equalityFunction_(equal) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat " + path);
+    }
+    length_ = static_cast<size_t>(status.st_size);
+    if (length_ < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Not a map snapshot");
+    }
+    base_ = ::mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        throw std::system_error(error, std::generic_category(), "mmap " + path);
+    }
+
+    const char* bytes = static_cast<const char*>(base_);
+    SnapshotHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    try {
+        check_(header, length_);
+    } catch (...) {
+        release_();
+        throw;
+    }
+
+    size_ = header.size;
+    bucketCount_ = bucketPolicy_.reset(header.bucketCount);
+    buckets_ = reinterpret_cast<const uint64_t*>(bytes + header.bucketsOffset);
+    hashes_ = reinterpret_cast<const uint64_t*>(bytes + header.hashesOffset);
+    entries_ = reinterpret_cast<const NodeType*>(bytes + header.entriesOffset);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+MappedMap<Key, Value, Hash, Equal, BucketPolicy>::MappedMap(MappedMap&& other)
+    : base_(other.base_), length_(other.length_), size_(other.size_), bucketCount_(other.bucketCount_),
+      buckets_(other.buckets_), hashes_(other.hashes_), entries_(other.entries_), bucketPolicy_(other.bucketPolicy_),
+      hashFunction_(std::move(other.hashFunction_)), equalityFunction_(std::move(other.equalityFunction_)) {
+    other.base_ = nullptr;
+    other.length_ = 0;
+    other.size_ = 0;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+MappedMap<Key, Value, Hash, Equal, BucketPolicy>& MappedMap<Key, Value, Hash, Equal, BucketPolicy>::operator=(MappedMap&& other) {
+    std::swap(base_, other.base_);
+    std::swap(length_, other.length_);
+    std::swap(size_, other.size_);
+    std::swap(bucketCount_, other.bucketCount_);
+    std::swap(buckets_, other.buckets_);
+    std::swap(hashes_, other.hashes_);
+    std::swap(entries_, other.entries_);
+    std::swap(bucketPolicy_, other.bucketPolicy_);
+    std::swap(hashFunction_, other.hashFunction_);
+    std::swap(equalityFunction_, other.equalityFunction_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+void MappedMap<Key, Value, Hash, Equal, BucketPolicy>::release_() {
+    if (base_) {
+        ::munmap(base_, length_);
+        base_ = nullptr;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+typename MappedMap<Key, Value, Hash, Equal, BucketPolicy>::const_iterator MappedMap<Key, Value, Hash, Equal, BucketPolicy>::find(const Key& key) const {
+    if (!base_) {
+        return end();
+    }
+    uint64_t hash = static_cast<uint64_t>(hashFunction_(key));
+    size_t index = bucketPolicy_.index(static_cast<size_t>(hash));
+    // The offsets are not validated on open, so a damaged snapshot may hold any; the scan never leaves the entries.
+    uint64_t last = std::min<uint64_t>(buckets_[index + 1], size_);
+    for (uint64_t i = buckets_[index]; i < last; ++i) {
+        if (hashes_[i] == hash && equalityFunction_(entries_[i].first, key)) {
+            return entries_ + i;
+        }
+    }
+    return end();
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename BucketPolicy>
+const Value& MappedMap<Key, Value, Hash, Equal, BucketPolicy>::at(const Key& key) const {
+    const_iterator it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("No Key");
+    }
+    return it->second;
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "UnMap.cpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+
+// Hash map for many readers and one writer at a time.
+// Readers never lock and never write a shared cache line: a lookup only publishes the current
+// epoch in the reader's own slot, loads the bucket array and walks its chain.
+// Writers are serialized by a mutex. They publish every change with a single pointer store,
+// so an element is never modified in place: insert_or_assign links a new node instead of the
+// old one, and growing builds a whole new table.
+// Unlinked nodes and replaced tables are freed once every reader that could still see them
+// has left its read section (epoch-based reclamation).
+template<
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> >,
+    typename BucketPolicy = DefaultBuckets<Hash> >
+class ReadMostlyMap {
+public:
+    using NodeType = std::pair<const Key, Value>;
+
+private:
+    static const size_t cacheLine_ = 64;
+    static const size_t maxReaders_ = 256;
+    static const size_t reclaimBatch_ = 64;
+    static constexpr double baseMaxLoadFactor_ = 0.5;
+    static const size_t baseSize_ = 16;
+    static const size_t resizeMultiply = 4;
+
+    class Node_ {
+    public:
+        NodeType data_;
+        size_t hash_;
+        std::atomic<Node_*> next_;
+
+        template<typename... Args>
+        Node_(size_t hash, Args&& ...args) : data_(std::forward<Args>(args)...), hash_(hash), next_(nullptr) {}
+    };
+
+    class Table_ {
+    public:
+        BucketPolicy policy;
+        size_t capacity;
+        std::atomic<Node_*>* buckets;
+
+        explicit Table_(size_t count) {
+            capacity = policy.reset(count);
+            buckets = new std::atomic<Node_*> [capacity];
+            for (size_t i = 0; i < capacity; ++i) {
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        ~Table_() {delete[] buckets;}
+    };
+
+    // 0 means the slot's reader is outside of a read section.
+    class alignas(cacheLine_) Slot_ {
+    public:
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> used{false};
+    };
+
+    class Retired_ {
+    public:
+        uint64_t epoch;
+        Node_* node;
+        Table_* table;
+    };
+
+    using nodeAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<Node_>;
+
+    std::atomic<Table_*> table_;
+    alignas(cacheLine_) std::atomic<uint64_t> globalEpoch_{1};
+    mutable Slot_ slots_[maxReaders_];
+
+    std::mutex writeLock_;
+    Hash hashFunction_;
+    Equal equalityFunction_;
+    nodeAllocator nodeAlloc_;
+    double maxLoadFactor_ = baseMaxLoadFactor_;
+    // Only the writer changes it, readers may call size() at any time.
+    std::atomic<size_t> size_{0};
+    size_t maxSize_;
+    std::vector<Retired_> retired_;
+
+    template<typename... Args>
+    Node_* requireNode_(size_t hash, Args&& ...args);
+    void removeNode_(Node_* node);
+    void removeTable_(Table_* table);
+    Node_* findNode_(const Table_* table, const Key& key, size_t hash) const;
+    std::atomic<Node_*>* findLink_(Table_* table, const Key& key, size_t hash);
+    void updateMaxSize_(const Table_* table);
+    void rebuild_(size_t count);
+    void link_(const Key& key, const Value& value, size_t hash);
+    void retire_(Node_* node, Table_* table);
+    void reclaim_();
+    void enter_(size_t slot) const;
+    void leave_(size_t slot) const;
+
+public:
+    class Reader {
+    private:
+        const ReadMostlyMap* map_;
+        size_t slot_;
+
+    public:
+        Reader(const ReadMostlyMap* map, size_t slot) : map_(map), slot_(slot) {}
+        Reader(const Reader& other) = delete;
+        Reader(Reader&& other) : map_(other.map_), slot_(other.slot_) {other.map_ = nullptr;}
+        Reader& operator=(const Reader& other) = delete;
+        ~Reader();
+
+        template<typename F>
+        bool visit(const Key& key, F&& f) const;
+        bool find(const Key& key, Value& result) const;
+        bool contains(const Key& key) const;
+    };
+
+    ReadMostlyMap();
+    ReadMostlyMap(const ReadMostlyMap& other) = delete;
+    ReadMostlyMap& operator=(const ReadMostlyMap& other) = delete;
+    ~ReadMostlyMap();
+
+    Reader reader() const;
+    size_t size() const {return size_.load(std::memory_order_relaxed);}
+    bool insert(const Key& key, const Value& value);
+    bool insert_or_assign(const Key& key, const Value& value);
+    bool erase(const Key& key);
+    void reserve(size_t count);
+};
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::ReadMostlyMap() {
+    Table_* table = new Table_(baseSize_);
+    updateMaxSize_(table);
+    table_.store(table, std::memory_order_release);
+}
+
+// Readers must be gone by now, so everything retired can be freed right away.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::~ReadMostlyMap() {
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        if (retired_[i].node) {
+            removeNode_(retired_[i].node);
+        } else {
+            removeTable_(retired_[i].table);
+        }
+    }
+    removeTable_(table_.load(std::memory_order_relaxed));
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename... Args>
+typename ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Node_* ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::requireNode_(size_t hash, Args&& ...args) {
+    Node_* node = std::allocator_traits<nodeAllocator>::allocate(nodeAlloc_, 1);
+    std::allocator_traits<nodeAllocator>::construct(nodeAlloc_, node, hash, std::forward<Args>(args)...);
+    return node;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::removeNode_(Node_* node) {
+    std::allocator_traits<nodeAllocator>::destroy(nodeAlloc_, node);
+    std::allocator_traits<nodeAllocator>::deallocate(nodeAlloc_, node, 1);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::removeTable_(Table_* table) {
+    for (size_t i = 0; i < table->capacity; ++i) {
+        Node_* node = table->buckets[i].load(std::memory_order_relaxed);
+        while (node) {
+            Node_* next = node->next_.load(std::memory_order_relaxed);
+            removeNode_(node);
+            node = next;
+        }
+    }
+    delete table;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::updateMaxSize_(const Table_* table) {
+    maxSize_ = static_cast<size_t>(static_cast<double>(table->capacity) * maxLoadFactor_);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Node_* ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::findNode_(const Table_* table, const Key& key, size_t hash) const {
+    Node_* node = table->buckets[table->policy.index(hash)].load(std::memory_order_acquire);
+    while (node) {
+        if (node->hash_ == hash && equalityFunction_(node->data_.first, key)) {
+            return node;
+        }
+        node = node->next_.load(std::memory_order_acquire);
+    }
+    return nullptr;
+}
+
+// Writer side: returns the link that points to the node with key, or nullptr.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+std::atomic<typename ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Node_*>* ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::findLink_(Table_* table, const Key& key, size_t hash) {
+    std::atomic<Node_*>* link = &table->buckets[table->policy.index(hash)];
+    for (Node_* node = link->load(std::memory_order_relaxed); node; node = link->load(std::memory_order_relaxed)) {
+        if (node->hash_ == hash && equalityFunction_(node->data_.first, key)) {
+            return link;
+        }
+        link = &node->next_;
+    }
+    return nullptr;
+}
+
+// Readers may still walk the chains of the current table, so its nodes are copied
+// rather than relinked, and the old table is retired together with its nodes.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::rebuild_(size_t count) {
+    Table_* oldTable = table_.load(std::memory_order_relaxed);
+    Table_* newTable = new Table_(count);
+
+    for (size_t i = 0; i < oldTable->capacity; ++i) {
+        for (Node_* node = oldTable->buckets[i].load(std::memory_order_relaxed); node; node = node->next_.load(std::memory_order_relaxed)) {
+            Node_* copy = requireNode_(node->hash_, node->data_);
+            std::atomic<Node_*>& head = newTable->buckets[newTable->policy.index(copy->hash_)];
+            copy->next_.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            head.store(copy, std::memory_order_relaxed);
+        }
+    }
+
+    updateMaxSize_(newTable);
+    table_.store(newTable, std::memory_order_release);
+    retire_(nullptr, oldTable);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::retire_(Node_* node, Table_* table) {
+    retired_.push_back({globalEpoch_.fetch_add(1, std::memory_order_acq_rel), node, table});
+    if (table || retired_.size() >= reclaimBatch_) {
+        reclaim_();
+    }
+}
+
+// Something retired at epoch e is unreachable for every reader that entered later,
+// so it can go once no active reader has published an epoch of e or less.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::reclaim_() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t minEpoch = globalEpoch_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < maxReaders_; ++i) {
+        uint64_t epoch = slots_[i].epoch.load(std::memory_order_acquire);
+        if (epoch && epoch < minEpoch) {
+            minEpoch = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        if (retired_[i].epoch < minEpoch) {
+            if (retired_[i].node) {
+                removeNode_(retired_[i].node);
+            } else {
+                removeTable_(retired_[i].table);
+            }
+        } else {
+            retired_[kept++] = retired_[i];
+        }
+    }
+    retired_.resize(kept);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::enter_(size_t slot) const {
+    slots_[slot].epoch.store(globalEpoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::leave_(size_t slot) const {
+    slots_[slot].epoch.store(0, std::memory_order_release);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Reader ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::reader() const {
+    for (size_t i = 0; i < maxReaders_; ++i) {
+        bool expected = false;
+        if (slots_[i].used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return Reader(this, i);
+        }
+    }
+    throw std::length_error("Too many readers");
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Reader::~Reader() {
+    if (map_) {
+        map_->slots_[slot_].used.store(false, std::memory_order_release);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Reader::visit(const Key& key, F&& f) const {
+    size_t hash = map_->hashFunction_(key);
+    map_->enter_(slot_);
+    const Table_* table = map_->table_.load(std::memory_order_acquire);
+    Node_* node = map_->findNode_(table, key, hash);
+    if (node) {
+        f(node->data_.second);
+    }
+    map_->leave_(slot_);
+    return node;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Reader::find(const Key& key, Value& result) const {
+    return visit(key, [&result](const Value& value) {result = value;});
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Reader::contains(const Key& key) const {
+    return visit(key, [](const Value&) {});
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::link_(const Key& key, const Value& value, size_t hash) {
+    Table_* table = table_.load(std::memory_order_relaxed);
+    if (size_.load(std::memory_order_relaxed) >= maxSize_) {
+        rebuild_(table->capacity * resizeMultiply);
+        table = table_.load(std::memory_order_relaxed);
+    }
+
+    Node_* node = requireNode_(hash, key, value);
+    std::atomic<Node_*>& head = table->buckets[table->policy.index(hash)];
+    node->next_.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    head.store(node, std::memory_order_release);
+    size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert(const Key& key, const Value& value) {
+    std::lock_guard<std::mutex> guard(writeLock_);
+    size_t hash = hashFunction_(key);
+    if (findNode_(table_.load(std::memory_order_relaxed), key, hash)) {
+        return false;
+    }
+
+    link_(key, value, hash);
+    return true;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert_or_assign(const Key& key, const Value& value) {
+    std::lock_guard<std::mutex> guard(writeLock_);
+    size_t hash = hashFunction_(key);
+    std::atomic<Node_*>* link = findLink_(table_.load(std::memory_order_relaxed), key, hash);
+    if (!link) {
+        link_(key, value, hash);
+        return true;
+    }
+
+    Node_* old = link->load(std::memory_order_relaxed);
+    Node_* node = requireNode_(hash, key, value);
+    node->next_.store(old->next_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    link->store(node, std::memory_order_release);
+    retire_(old, nullptr);
+    return false;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+bool ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::erase(const Key& key) {
+    std::lock_guard<std::mutex> guard(writeLock_);
+    std::atomic<Node_*>* link = findLink_(table_.load(std::memory_order_relaxed), key, hashFunction_(key));
+    if (!link) {
+        return false;
+    }
+
+    Node_* old = link->load(std::memory_order_relaxed);
+    link->store(old->next_.load(std::memory_order_relaxed), std::memory_order_release);
+    size_.store(size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    retire_(old, nullptr);
+    return true;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void ReadMostlyMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::reserve(size_t count) {
+    std::lock_guard<std::mutex> guard(writeLock_);
+    size_t newCount = static_cast<size_t>(static_cast<double>(count) / maxLoadFactor_) + 1;
+    if (newCount > table_.load(std::memory_order_relaxed)->capacity) {
+        rebuild_(newCount);
+    }
+}
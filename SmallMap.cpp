@@ -0,0 +1,375 @@
+#pragma once
+
+#include "UnMap.cpp"
+#include <new>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Map that keeps up to N elements inline and finds them by a linear scan. Inserting one more
+// moves everything into an UnorderedMap built in the same storage, and the map stays hashed
+// until clear(). An empty map allocates nothing, neither do maps that never outgrow N.
+// For 4 and 8 byte integral keys compared with std::equal_to the scan uses SSE2 on a copy of the keys.
+template<
+    typename Key,
+    typename Value,
+    size_t N = 8,
+    typename Hash = std::hash<Key>,
+    typename Equal = std::equal_to<Key>,
+    typename Alloc = std::allocator<std::pair<const Key, Value> >,
+    typename BucketPolicy = DefaultBuckets<Hash> >
+class SmallMap {
+    static_assert(N > 0, "SmallMap needs room for at least one inline element");
+
+public:
+    using NodeType = std::pair<const Key, Value>;
+    using LargeMap = UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>;
+
+private:
+#ifdef __SSE2__
+    static constexpr bool simdKeys_ = std::is_integral<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8) &&
+                                      std::is_same<Equal, std::equal_to<Key> >::value;
+#else
+    static constexpr bool simdKeys_ = false;
+#endif
+    static constexpr size_t keysPerVector_ = 16 / sizeof(Key);
+    static constexpr size_t mirrorSize_ = simdKeys_ ? (N + keysPerVector_ - 1) / keysPerVector_ * keysPerVector_ : 0;
+
+    using MirrorKey_ = std::conditional_t<simdKeys_, Key, unsigned char>;
+
+    class Inline_ {
+    public:
+        alignas(NodeType) unsigned char slots[N * sizeof(NodeType)];
+        alignas(16) MirrorKey_ keys[mirrorSize_ ? mirrorSize_ : 1];
+    };
+
+    union {
+        Inline_ small_;
+        LargeMap large_;
+    };
+    bool isLarge_ = false;
+    size_t size_ = 0;
+    Equal equalityFunction_;
+
+    NodeType* slot_(size_t i) {return std::launder(reinterpret_cast<NodeType*>(small_.slots) + i);}
+    const NodeType* slot_(size_t i) const {return std::launder(reinterpret_cast<const NodeType*>(small_.slots) + i);}
+    size_t findInline_(const Key& key) const;
+    template<typename... Args>
+    NodeType* appendInline_(Args&&... args);
+    void eraseInline_(size_t i);
+    void destroyInline_();
+    void spill_();
+    void reset_();
+    void moveFrom_(SmallMap& other);
+
+    template<typename Node, typename LargeIterator>
+    class Iterator_ {
+        friend class SmallMap;
+        Node* slot_ = nullptr;
+        LargeIterator large_;
+        bool isLarge_ = false;
+
+        explicit Iterator_(Node* slot) : slot_(slot) {}
+        explicit Iterator_(const LargeIterator& large) : large_(large), isLarge_(true) {}
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Node;
+        using pointer = Node*;
+        using difference_type = size_t;
+        using reference = Node&;
+
+        Iterator_() {}
+        Node& operator*() {return isLarge_ ? *large_ : *slot_;}
+        Node* operator->() {return &**this;}
+        Iterator_& operator++() {
+            if (isLarge_) {
+                ++large_;
+            } else {
+                ++slot_;
+            }
+            return *this;
+        }
+        Iterator_ operator++(int) {Iterator_ it = *this; ++*this; return it;}
+        bool operator==(const Iterator_& other) {return isLarge_ ? large_ == other.large_ : slot_ == other.slot_;}
+        bool operator!=(const Iterator_& other) {return !(*this == other);}
+    };
+
+public:
+    using iterator = Iterator_<NodeType, typename LargeMap::iterator>;
+    using const_iterator = Iterator_<const NodeType, typename LargeMap::const_iterator>;
+
+    SmallMap() {}
+    SmallMap(const SmallMap& other);
+    SmallMap(SmallMap&& other);
+    SmallMap& operator=(const SmallMap& other);
+    SmallMap& operator=(SmallMap&& other);
+    ~SmallMap() {reset_();}
+
+    size_t size() const {return isLarge_ ? large_.size() : size_;}
+    bool empty() const {return size() == 0;}
+    // True while the elements are stored inline.
+    bool is_inline() const {return !isLarge_;}
+
+    iterator begin() {return isLarge_ ? iterator(large_.begin()) : iterator(slot_(0));}
+    iterator end() {return isLarge_ ? iterator(large_.end()) : iterator(slot_(size_));}
+    const_iterator cbegin() const {return isLarge_ ? const_iterator(large_.cbegin()) : const_iterator(slot_(0));}
+    const_iterator cend() const {return isLarge_ ? const_iterator(large_.cend()) : const_iterator(slot_(size_));}
+    const_iterator begin() const {return cbegin();}
+    const_iterator end() const {return cend();}
+
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const {return isLarge_ ? large_.contains(key) : findInline_(key) != size_;}
+    size_t count(const Key& key) const {return contains(key);}
+    Value& at(const Key& key);
+    const Value& at(const Key& key) const;
+    Value& operator[](const Key& key) {return try_emplace(key).first->second;}
+
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    std::pair<iterator, bool> insert(const NodeType& x) {return try_emplace(x.first, x.second);}
+    size_t erase(const Key& key);
+    // Destroys the elements and returns to inline storage.
+    void clear() {reset_();}
+};
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+size_t SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::findInline_(const Key& key) const {
+#ifdef __SSE2__
+    if constexpr (simdKeys_) {
+        __m128i needle = sizeof(Key) == 4 ? _mm_set1_epi32(static_cast<int32_t>(key)) : _mm_set1_epi64x(static_cast<int64_t>(key));
+        for (size_t i = 0; i < size_; i += keysPerVector_) {
+            __m128i keys = _mm_load_si128(reinterpret_cast<const __m128i*>(small_.keys + i));
+            __m128i equal = _mm_cmpeq_epi32(keys, needle);
+            uint32_t mask;
+            if (sizeof(Key) == 4) {
+                mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+            } else {
+                // A 64-bit lane matches if both of its 32-bit halves do.
+                equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+                mask = static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(equal)));
+            }
+            // Lanes past size_ hold stale keys.
+            if (size_ - i < keysPerVector_) {
+                mask &= (1u << (size_ - i)) - 1;
+            }
+            if (mask) {
+                return i + static_cast<size_t>(__builtin_ctz(mask));
+            }
+        }
+        return size_;
+    }
+#endif
+    for (size_t i = 0; i < size_; ++i) {
+        if (equalityFunction_(slot_(i)->first, key)) {
+            return i;
+        }
+    }
+    return size_;
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename... Args>
+typename SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::NodeType* SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::appendInline_(Args&&... args) {
+    NodeType* node = new (small_.slots + size_ * sizeof(NodeType)) NodeType(std::forward<Args>(args)...);
+    if constexpr (simdKeys_) {
+        small_.keys[size_] = node->first;
+    }
+    ++size_;
+    return node;
+}
+
+// The last element fills the hole, so the inline elements stay contiguous.
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::eraseInline_(size_t i) {
+    --size_;
+    slot_(i)->~NodeType();
+    if (i != size_) {
+        new (small_.slots + i * sizeof(NodeType)) NodeType(std::move(*slot_(size_)));
+        slot_(size_)->~NodeType();
+        if constexpr (simdKeys_) {
+            small_.keys[i] = small_.keys[size_];
+        }
+    }
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::destroyInline_() {
+    for (size_t i = 0; i < size_; ++i) {
+        slot_(i)->~NodeType();
+    }
+    size_ = 0;
+}
+
+// large_ shares the storage of the inline elements, so they are moved out into a local map first.
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::spill_() {
+    LargeMap large;
+    large.reserve(2 * N);
+    for (size_t i = 0; i < size_; ++i) {
+        large.emplace(std::move(*slot_(i)));
+    }
+    destroyInline_();
+    new (&large_) LargeMap(std::move(large));
+    isLarge_ = true;
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::reset_() {
+    if (isLarge_) {
+        large_.~LargeMap();
+        isLarge_ = false;
+    } else {
+        destroyInline_();
+    }
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::SmallMap(const SmallMap& other) : equalityFunction_(other.equalityFunction_) {
+    if (other.isLarge_) {
+        new (&large_) LargeMap(other.large_);
+        isLarge_ = true;
+        return;
+    }
+    for (size_t i = 0; i < other.size_; ++i) {
+        appendInline_(*other.slot_(i));
+    }
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::moveFrom_(SmallMap& other) {
+    if (other.isLarge_) {
+        new (&large_) LargeMap(std::move(other.large_));
+        isLarge_ = true;
+    } else {
+        for (size_t i = 0; i < other.size_; ++i) {
+            appendInline_(std::move(*other.slot_(i)));
+        }
+    }
+    other.reset_();
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>& SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::operator=(const SmallMap& other) {
+    if (this != &other) {
+        SmallMap copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::SmallMap(SmallMap&& other) : equalityFunction_(std::move(other.equalityFunction_)) {
+    moveFrom_(other);
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>& SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::operator=(SmallMap&& other) {
+    if (this != &other) {
+        reset_();
+        equalityFunction_ = std::move(other.equalityFunction_);
+        moveFrom_(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::iterator SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::find(const Key& key) {
+    if (isLarge_) {
+        return iterator(large_.find(key));
+    }
+    return iterator(slot_(findInline_(key)));
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::const_iterator SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::find(const Key& key) const {
+    if (isLarge_) {
+        return const_iterator(large_.find(key));
+    }
+    return const_iterator(slot_(findInline_(key)));
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+Value& SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::at(const Key& key) {
+    if (isLarge_) {
+        return large_.at(key);
+    }
+    size_t i = findInline_(key);
+    if (i == size_) {
+        throw std::out_of_range("No Key");
+    }
+    return slot_(i)->second;
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+const Value& SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::at(const Key& key) const {
+    return const_cast<SmallMap*>(this)->at(key);
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename... Args>
+std::pair<typename SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::try_emplace(const Key& key, Args&&... args) {
+    if (!isLarge_) {
+        size_t i = findInline_(key);
+        if (i != size_) {
+            return {iterator(slot_(i)), false};
+        }
+        if (size_ < N) {
+            return {iterator(appendInline_(std::piecewise_construct, std::forward_as_tuple(key),
+                                           std::forward_as_tuple(std::forward<Args>(args)...))), true};
+        }
+        spill_();
+    }
+    std::pair<typename LargeMap::iterator, bool> answer = large_.try_emplace(key, std::forward<Args>(args)...);
+    return {iterator(answer.first), answer.second};
+}
+
+// Like UnorderedMap::emplace, the element is built before its key is looked up.
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename... Args>
+std::pair<typename SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::emplace(Args&&... args) {
+    if (!isLarge_ && size_ < N) {
+        NodeType* node = appendInline_(std::forward<Args>(args)...);
+        size_t i = findInline_(node->first);
+        if (i != size_ - 1) {
+            eraseInline_(size_ - 1);
+            return {iterator(slot_(i)), false};
+        }
+        return {iterator(node), true};
+    }
+    if (!isLarge_) {
+        NodeType node(std::forward<Args>(args)...);
+        size_t i = findInline_(node.first);
+        if (i != size_) {
+            return {iterator(slot_(i)), false};
+        }
+        spill_();
+        std::pair<typename LargeMap::iterator, bool> answer = large_.emplace(std::move(node));
+        return {iterator(answer.first), answer.second};
+    }
+    std::pair<typename LargeMap::iterator, bool> answer = large_.emplace(std::forward<Args>(args)...);
+    return {iterator(answer.first), answer.second};
+}
+
+template<typename Key, typename Value, size_t N, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+size_t SmallMap<Key, Value, N, Hash, Equal, Alloc, BucketPolicy>::erase(const Key& key) {
+    if (isLarge_) {
+        return large_.erase(key);
+    }
+    size_t i = findInline_(key);
+    if (i == size_) {
+        return 0;
+    }
+    eraseInline_(i);
+    return 1;
+}
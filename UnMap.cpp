@@ -1,6 +1,24 @@
+#pragma once
+
 #include "ListAndAlloc.h"
+#include "Interleave.cpp"
+#include "FastHash.cpp"
 #include <utility>
 #include <iterator>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <tuple>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <thread>
+#include <system_error>
+#include <exception>
+#include <atomic>
+#include <optional>
+#include <stdexcept>
 
 template<typename T, typename U>
 std::ostream& operator<<(std::ostream& out, const std::pair<T, U>& p) {
@@ -8,13 +26,179 @@ std::ostream& operator<<(std::ostream& out, const std::pair<T, U>& p) {
     return out;
 }
 
+// True when T declares is_transparent, like std::equal_to<>.
+template<typename T, typename = void>
+class IsTransparent : public std::false_type {};
+
+template<typename T>
+class IsTransparent<T, std::void_t<typename T::is_transparent> > : public std::true_type {};
+
+// Whether UnorderedMap keeps the hash of every key in its node, so rehashing never calls Hash.
+// Specializing it to false is an opt-in for keys that hash cheaply: the node is 8 bytes smaller,
+// but every chain walk and rehash calls Hash again for each node it passes.
+template<typename Key, typename Hash>
+class CachesHash : public std::true_type {};
+
+// Snapshot of the shape of an UnorderedMap, see UnorderedMap::stats().
+class MapStats {
+public:
+    size_t size = 0;
+    size_t bucketCount = 0;
+    // chainHistogram[k] is the number of buckets holding exactly k elements.
+    std::vector<size_t> chainHistogram;
+    size_t maxChain = 0;
+    double emptyBucketFraction = 0;
+    // Nodes a lookup examines on average, if every key (hit) or every bucket (miss) is equally likely.
+    double averageHitProbes = 0;
+    double averageMissProbes = 0;
+    size_t rehashCount = 0;
+    double rehashSeconds = 0;
+    size_t bucketBytes = 0;
+    size_t nodeBytes = 0;
+    // What the node allocator holds beyond the nodes themselves: malloc rounding or unused pool chunks.
+    size_t allocatorSlackBytes = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const MapStats& stats) {
+    out << "size " << stats.size << ", buckets " << stats.bucketCount << ", empty " << stats.emptyBucketFraction
+        << ", max chain " << stats.maxChain << std::endl;
+    out << "chains:";
+    for (size_t i = 0; i < stats.chainHistogram.size(); ++i) {
+        out << ' ' << i << ':' << stats.chainHistogram[i];
+    }
+    out << std::endl;
+    out << "probes per hit " << stats.averageHitProbes << ", per miss " << stats.averageMissProbes << std::endl;
+    out << "rehashes " << stats.rehashCount << " in " << stats.rehashSeconds << " s" << std::endl;
+    out << "bytes: buckets " << stats.bucketBytes << ", nodes " << stats.nodeBytes
+        << ", allocator slack " << stats.allocatorSlackBytes << std::endl;
+    return out;
+}
+
+// Per-operation counters, kept only when the code is built with -DHASH_MAP_COUNTERS.
+// They are relaxed atomics, so concurrent const lookups may count at the same time.
+class MapCounters {
+public:
+    class Counter {
+    private:
+        std::atomic<size_t> value_{0};
+
+    public:
+        Counter() {}
+        Counter(const Counter& other) : value_(other) {}
+        Counter& operator=(const Counter& other) {value_.store(other, std::memory_order_relaxed); return *this;}
+        Counter& operator+=(size_t n) {value_.fetch_add(n, std::memory_order_relaxed); return *this;}
+        Counter& operator++() {return *this += 1;}
+        operator size_t() const {return value_.load(std::memory_order_relaxed);}
+    };
+
+    Counter probes;  // key searches, including those made by inserts and erases
+    Counter hits;
+    Counter nodesVisited;
+    Counter comparisons;  // calls of Equal
+    Counter hitComparisons;  // the part of comparisons made by searches that succeeded
+    Counter inserts;
+    Counter erases;
+};
+
+// Bucket indexing policies for UnorderedMap.
+// reset() picks the real bucket count for a requested one, index() maps a hash to a bucket.
+
+// Masks the bucket count, which is a power of two. The hash is mixed first:
+// std::hash of integers is the identity and would otherwise only use its low bits.
+class PowerOfTwoBuckets {
+private:
+    static const size_t minCount_ = 8;
+    // The largest power of two a size_t holds.
+    static const size_t maxCount_ = static_cast<size_t>(1) << (sizeof(size_t) * 8 - 1);
+    size_t mask_ = minCount_ - 1;
+
+public:
+    size_t reset(size_t atLeast) {
+        if (atLeast > maxCount_) {
+            throw std::length_error("Too many buckets");
+        }
+        size_t count = minCount_;
+        while (count < atLeast) {
+            count <<= 1;
+        }
+        mask_ = count - 1;
+        return count;
+    }
+
+    size_t index(size_t hash) const {
+        uint64_t x = static_cast<uint64_t>(hash);
+        x ^= x >> 32;
+        x *= 0x9E3779B97F4A7C15ULL;
+        x ^= x >> 29;
+        return static_cast<size_t>(x) & mask_;
+    }
+};
+
+// Masks the bucket count, which is a power of two, without mixing: for hashes that are already well mixed.
+class MaskedBuckets {
+private:
+    static const size_t minCount_ = 8;
+    // The largest power of two a size_t holds.
+    static const size_t maxCount_ = static_cast<size_t>(1) << (sizeof(size_t) * 8 - 1);
+    size_t mask_ = minCount_ - 1;
+
+public:
+    size_t reset(size_t atLeast) {
+        if (atLeast > maxCount_) {
+            throw std::length_error("Too many buckets");
+        }
+        size_t count = minCount_;
+        while (count < atLeast) {
+            count <<= 1;
+        }
+        mask_ = count - 1;
+        return count;
+    }
+
+    size_t index(size_t hash) const {
+        return hash & mask_;
+    }
+};
+
+// Takes the hash modulo a prime, for hashes too weak for the mixed mask.
+class PrimeBuckets {
+private:
+    size_t count_ = 11;
+
+public:
+    size_t reset(size_t atLeast) {
+        static const uint64_t primes[] = {
+            11, 23, 47, 97, 197, 397, 797, 1597, 3203, 6421, 12853, 25717, 51437, 102877,
+            205759, 411527, 823117, 1646237, 3292489, 6584983, 13169977, 26339969, 52679969,
+            105359939, 210719881, 421439783, 842879579, 1685759167, 3371518343ULL, 6743036717ULL,
+            13486073473ULL, 26972146961ULL, 53944293929ULL, 107888587883ULL, 215777175787ULL,
+            431554351609ULL, 863108703229ULL, 1726217406467ULL};
+        for (uint64_t prime : primes) {
+            if (prime >= atLeast) {
+                count_ = static_cast<size_t>(prime);
+                return count_;
+            }
+        }
+        count_ = atLeast | 1;
+        return count_;
+    }
+
+    size_t index(size_t hash) const {
+        return hash % count_;
+    }
+};
+
+// The policy the maps use unless told otherwise: the mask alone when Hash declares is_avalanching.
+template<typename Hash>
+using DefaultBuckets = std::conditional_t<IsAvalanching<Hash>::value, MaskedBuckets, PowerOfTwoBuckets>;
 
 template<
     typename Key,
     typename Value,
     typename Hash = std::hash<Key>,
     typename Equal = std::equal_to<Key>,
-    typename Alloc = std::allocator<std::pair<const Key, Value> > >
+    typename Alloc = std::allocator<std::pair<const Key, Value> >,
+    typename BucketPolicy = DefaultBuckets<Hash> >
 class UnorderedMap {
 public:
     using NodeType = std::pair<const Key, Value>;
@@ -22,28 +206,153 @@ public:
     friend std::ostream& operator&(std::ostream& out, UnorderedMap<T, U, H, E, A>& Table);
 
 private:
-    using NodePtr = typename List<NodeType, Alloc>::Node*;
-    using subIterator = typename List<NodeType, Alloc>::iterator;
-    using subConstIterator = typename List<NodeType, Alloc>::const_iterator;
-
-    subIterator* dataArray_;
+    static constexpr bool cacheHash_ = CachesHash<Key, Hash>::value;
+    using Nodes_ = ForwardList<NodeType, typename NodeAllocatorFor<Alloc>::type, cacheHash_>;
+    using NodePtr = typename Nodes_::Node*;
+    using LinkPtr = typename Nodes_::Link*;
+    using subIterator = typename Nodes_::iterator;
+    using subConstIterator = typename Nodes_::const_iterator;
+
+    // The nodes of a bucket are adjacent in listOfNodes. Its slot holds the link before the
+    // first of them, which is the last node of another bucket or the list's own before-link,
+    // and is null for an empty bucket. So a node is unlinked without a back pointer.
+    LinkPtr* dataArray_;
     double maxLoadFactor_;
     Hash hashFunction_;
     Equal equalityFunction_;
-    Alloc alloc_;
+    BucketPolicy bucketPolicy_;
     static constexpr double baseMaxLoadFactor_ = 0.5;
     static const size_t baseSize_ = 10;
     static const size_t resizeMultiply = 4;
     size_t size_ = 0;
     size_t capacity_;
-    List<NodeType, Alloc> listOfNodes;
-    static bool theSameHash_(subIterator it, const Key& value);
-    static bool theSameHash_(subConstIterator it, const Key& value);
+    size_t maxSize_;
+    LinkPtr* oldArray_ = nullptr;
+    BucketPolicy oldBucketPolicy_;
+    size_t oldCapacity_ = 0;
+    size_t migrated_ = 0;
+    size_t migrationStep_ = 0;
+    // A new dataArray_ is zeroed in slices before the first bucket migrates, this many slots per
+    // bucket of a step's budget. Slots from zeroedSlots_ on are not zeroed yet.
+    static const size_t zeroSlotsPerBucket_ = 64;
+    size_t zeroedSlots_ = 0;
+    size_t rehashThreads_ = 1;
+    static const size_t parallelRehashGrain_ = 1 << 15;
+    static constexpr size_t emplaceReserveLimit_ = 1 << 20;
+    // Old buckets are walked in index order, their heads are prefetched this many buckets ahead.
+    static const size_t rehashPrefetch_ = 8;
+    size_t rehashCount_ = 0;
+    double rehashSeconds_ = 0;
+#ifdef HASH_MAP_COUNTERS
+    mutable MapCounters counters_;
+    void countProbe_(bool hit, size_t visited, size_t compared) const {
+        ++counters_.probes;
+        counters_.hits += hit;
+        counters_.nodesVisited += visited;
+        counters_.comparisons += compared;
+        counters_.hitComparisons += hit ? compared : 0;
+    }
+    void countInsert_() {++counters_.inserts;}
+    void countErase_() {++counters_.erases;}
+#else
+    void countProbe_(bool, size_t, size_t) const {}
+    void countInsert_() {}
+    void countErase_() {}
+#endif
+
+    // Adds the time of its scope to a running total.
+    class StopWatch_ {
+        double& total_;
+        std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+    public:
+        explicit StopWatch_(double& total) : total_(total) {}
+        ~StopWatch_() {total_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();}
+    };
+
+    size_t bucket_(size_t hash) const {return bucketPolicy_.index(hash);}
+    size_t locate_(size_t hash) const;
+    LinkPtr& head_(size_t location) const {return location < capacity_ ? dataArray_[location] : oldArray_[location - capacity_];}
+    NodePtr first_(size_t location) const {LinkPtr before = head_(location); return before ? before->next_ : nullptr;}
+    bool isZeroed_(size_t location) const {return !oldArray_ || location >= capacity_ || location < zeroedSlots_;}
+    void updateMaxSize_();
+    void startMigration_();
+    void migrateBucket_(size_t oldIndex);
+    void migrateStep_(size_t budget);
+    Nodes_ listOfNodes;
+    size_t hashOf_(const typename Nodes_::Node* node) const {
+        if constexpr (cacheHash_) {
+            return node->hash_;
+        } else {
+            return hashFunction_(node->data_.first);
+        }
+    }
+    bool inBucket_(const typename Nodes_::Node* node, size_t index) const {return node && locate_(hashOf_(node)) == index;}
+    template<typename K>
+    NodePtr findNode_(const K& key, size_t hash) const {size_t index = locate_(hash); return scanBucket_(first_(index), key, hash, index);}
+    template<typename K>
+    NodePtr scanBucket_(NodePtr v, const K& key, size_t hash, size_t index) const;
+    template<typename F>
+    void findBatch_(const Key* keys, size_t count, F&& emit) const;
+    static constexpr size_t batchGroup_ = 32;
+#ifdef HASH_HAS_COROUTINES
+    template<typename F>
+    InterleavedTask lookupTask_(const Key* keys, size_t count, size_t& next, F& emit) const;
+    template<typename F>
+    void findInterleaved_(const Key* keys, size_t count, size_t group, F&& emit) const;
+#endif
+    template<typename K>
+    Value& subscript_(K&& key);
+    template<typename K>
+    Value& at_(const K& key);
+    // The key's hash is passed in, so callers that already hashed it do not hash it again.
+    template<typename K>
+    size_t eraseKey_(const K& key, size_t hash);
+    template<typename... Args>
+    subIterator linkNode_(size_t hash, Args&& ...args) {return attachNode_(hash, listOfNodes.createNode(std::forward<Args>(args)...));}
+    subIterator attachNode_(size_t hash, NodePtr node);
+    void linkFirst_(NodePtr node, size_t location);
+    void relinkFront_();
+    template<typename... Args>
+    std::pair<subIterator, bool> emplaceNode_(Args&&... args);
+    template<typename U>
+    std::pair<subIterator, bool> insertNode_(U&& x);
+    NodePtr detachNode_(NodePtr node);
+    size_t nodeHash_(NodePtr node) const;
     void rehash_(size_t newSize = 0);
+    template<typename F>
+    void forEachRun_(LinkPtr* array, size_t first, size_t last, const BucketPolicy& policy, F&& f) const;
+    void regroup_(LinkPtr* oldArray, size_t oldCapacity, const BucketPolicy& oldPolicy);
+    void regroupParallel_(LinkPtr* oldArray, size_t oldCapacity, const BucketPolicy& oldPolicy, size_t threads, std::vector<NodePtr>& order);
+    static void firstNodes_(LinkPtr* array, size_t first, size_t last);
+    template<typename Iter>
+    void buildParallel_(Iter first, size_t count, size_t threads);
+    // Parallel regrouping and building split the buckets into one share per thread.
+    template<typename F>
+    static void runThreads_(size_t threads, F&& f);
+    static std::vector<size_t> prefixShares_(std::vector<size_t>& offsets, size_t threads);
+    size_t shareStart_(size_t share, size_t threads) const {return (capacity_ * share + threads - 1) / threads;}
+    size_t shareOwner_(size_t index, size_t threads) const {return index * threads / capacity_;}
+    // The nodes of one share chained in bucket order. Its first bucket still needs its before-link.
+    class Share_ {
+    public:
+        NodePtr first = nullptr;
+        NodePtr last = nullptr;
+        size_t firstBucket = 0;
+    };
+    static void appendToChain_(LinkPtr& slot, NodePtr v);
+    Share_ linkShare_(size_t share, size_t threads);
+    void linkShares_(const std::vector<Share_>& shares);
     void checkLoad_();
-    template<typename... Args>
-    NodeType* allocateNode_(Args&& ...args);
-    void deallocateNode_(NodeType* ptr);
+    // Parallel scans cut the buckets into this many ranges per thread, a thread that finishes
+    // its range takes the next one not taken yet.
+    static const size_t scanRangesPerThread_ = 8;
+    static const size_t parallelScanGrain_ = 1 << 14;
+    size_t scanThreads_(size_t threads) const;
+    template<typename Range>
+    std::vector<Range> split_(size_t parts) const;
+    template<typename Range, typename F>
+    static void scanRanges_(const std::vector<Range>& ranges, size_t threads, F&& f);
 
 
 public:
@@ -62,6 +371,7 @@ public:
         iterator& operator+=(size_t k);
         iterator operator+(size_t k) {iterator it = *this; return it += k;}
         iterator& operator=(const iterator& it) {data = it.data; return *this;}
+        iterator() {}
         iterator(const subIterator& other) : data(other) {}
         value_type* operator->() {return data.operator->();}
         bool operator==(const iterator& other) {return data == other.data;}
@@ -82,6 +392,7 @@ public:
         const_iterator operator++(int) {return const_iterator(data++);}
         const_iterator& operator+=(size_t k);
         const_iterator operator+(size_t k) {const_iterator it = *this; return it += k;}
+        const_iterator() {}
         const_iterator(const subConstIterator& other) : data(other) {}
         const_iterator(const iterator& other) : data(other.data) {}
         bool operator==(const const_iterator& other) {return data == other.data;}
@@ -90,7 +401,121 @@ public:
         const value_type* operator->() {return data.operator->();}
     };
 
+    // Owns one element node taken out of a map together with an allocator that can free it,
+    // so it may outlive the map it was extracted from.
+    class node_type {
+        friend class UnorderedMap;
+        using nodeAllocator_ = typename Nodes_::nodeAllocator;
+        NodePtr node_ = nullptr;
+        std::optional<nodeAllocator_> alloc_;
+        node_type(NodePtr node, nodeAllocator_&& alloc) : node_(node), alloc_(std::move(alloc)) {}
+        NodePtr release_() {NodePtr node = node_; node_ = nullptr; alloc_.reset(); return node;}
+
+    public:
+        node_type() {}
+        node_type(const node_type& other) = delete;
+        node_type(node_type&& other) : node_(other.node_), alloc_(std::move(other.alloc_)) {other.release_();}
+        node_type& operator=(const node_type& other) = delete;
+        node_type& operator=(node_type&& other);
+        ~node_type() {if (node_) {Nodes_::releaseNode(*alloc_, node_);}}
+        bool empty() const {return !node_;}
+        explicit operator bool() const {return node_;}
+        const Key& key() const {return node_->data_.first;}
+        Value& mapped() const {return node_->data_.second;}
+    };
+
+    class insert_return_type {
+    public:
+        iterator position;
+        bool inserted = false;
+        node_type node;
+    };
+
+private:
+    // The elements of the buckets [first_, last_), walked bucket by bucket.
+    template<typename Element>
+    class BucketRange_ {
+        friend class UnorderedMap;
+        const UnorderedMap* map_ = nullptr;
+        size_t first_ = 0;
+        size_t last_ = 0;
+        BucketRange_(const UnorderedMap* map, size_t first, size_t last) : map_(map), first_(first), last_(last) {}
+
+    public:
+        class iterator {
+            friend class BucketRange_;
+            const UnorderedMap* map_ = nullptr;
+            size_t location_ = 0;
+            size_t last_ = 0;
+            NodePtr node_ = nullptr;
+            iterator(const UnorderedMap* map, size_t location, size_t last) : map_(map), location_(location), last_(last) {seek_();}
+
+            void seek_() {
+                for (; location_ < last_; ++location_) {
+                    node_ = map_->isZeroed_(location_) ? map_->first_(location_) : nullptr;
+                    if (node_) {
+                        return;
+                    }
+                }
+                node_ = nullptr;
+            }
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Element;
+            using pointer = Element*;
+            using difference_type = std::ptrdiff_t;
+            using reference = Element&;
+
+            iterator() {}
+            iterator& operator++() {
+                node_ = node_->next_;
+                if (!map_->inBucket_(node_, location_)) {
+                    ++location_;
+                    seek_();
+                }
+                return *this;
+            }
+            iterator operator++(int) {iterator it = *this; ++*this; return it;}
+            bool operator==(const iterator& other) const {return node_ == other.node_;}
+            bool operator!=(const iterator& other) const {return !(*this == other);}
+            Element& operator*() const {return node_->data_;}
+            Element* operator->() const {return &node_->data_;}
+        };
+
+        BucketRange_() {}
+        iterator begin() const {return iterator(map_, first_, last_);}
+        iterator end() const {return iterator();}
+        size_t bucket_count() const {return last_ - first_;}
+    };
+
+public:
+    using bucket_range = BucketRange_<NodeType>;
+    using const_bucket_range = BucketRange_<const NodeType>;
+
+private:
+    // Overloads taking any key type K are enabled only when both Hash and Equal are transparent.
+    template<typename K>
+    using transparentKey_ = typename std::enable_if<
+        IsTransparent<Hash>::value && IsTransparent<Equal>::value &&
+        !std::is_convertible<const K&, iterator>::value && !std::is_convertible<const K&, const_iterator>::value, int>::type;
+
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> tryEmplace_(size_t hash, K&& key, Args&&... args);
+    template<typename K, typename M>
+    std::pair<iterator, bool> insertOrAssign_(size_t hash, K&& key, M&& value);
+
+    // ConcurrentMap hashes a key once to pick its shard and hands that hash to the shard's map.
+    template<typename K, typename V, typename H, typename E, typename A>
+    friend class ConcurrentMap;
+
+public:
+
     UnorderedMap();
+    // Builds the map from [first, last) like insert does. For random access ranges of at least
+    // 32K elements per thread the elements are hashed, partitioned by bucket and linked on up to threads threads.
+    template<typename Iter>
+    UnorderedMap(Iter first, Iter last, size_t threads = 1);
     UnorderedMap(const UnorderedMap& other);
     UnorderedMap(UnorderedMap&& other);
     UnorderedMap& operator=(const UnorderedMap& other);
@@ -101,91 +526,460 @@ public:
     const_iterator cbegin() const;
     const_iterator cend() const;
     iterator end();
-    Value& operator[](const Key& key);
-    Value& at(const Key& key);
+    Value& operator[](const Key& key) {return subscript_(key);}
+    Value& operator[](Key&& key) {return subscript_(std::move(key));}
+    Value& at(const Key& key) {return at_(key);}
+    template<typename K, transparentKey_<K> = 0>
+    Value& at(const K& key) {return at_(key);}
+    template<typename K, transparentKey_<K> = 0>
+    Value& operator[](K&& key) {return subscript_(std::forward<K>(key));}
     size_t capacity() const {return capacity_;}
     size_t size() const {return size_;}
     template<typename Iter>
     void insert(Iter first, Iter second);
     template<typename... Args>
     std::pair<iterator, bool> emplace(Args&&... args);
+    // Inserts count elements: make(construct) has to call construct(args...) once with the arguments
+    // of one element, as for emplace. Buckets for up to 1M elements are reserved once and those
+    // elements skip the load check; a larger count, which may come from untrusted input, grows as usual.
+    template<typename Make>
+    void emplace_n(size_t count, Make&& make);
     std::pair<iterator, bool> insert(const NodeType& x);
     template<typename U>
     std::pair<iterator, bool> insert(U&& x);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {return tryEmplace_(hashFunction_(key), key, std::forward<Args>(args)...);}
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {return tryEmplace_(hashFunction_(key), std::move(key), std::forward<Args>(args)...);}
+    template<typename K, typename... Args, transparentKey_<K> = 0>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {return tryEmplace_(hashFunction_(key), std::forward<K>(key), std::forward<Args>(args)...);}
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value) {return insertOrAssign_(hashFunction_(key), key, std::forward<M>(value));}
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value) {return insertOrAssign_(hashFunction_(key), std::move(key), std::forward<M>(value));}
     void erase(iterator it);
+    node_type extract(const_iterator it);
+    node_type extract(const Key& key);
+    insert_return_type insert(node_type&& handle);
+    void merge(UnorderedMap& source);
+    void merge(UnorderedMap&& source) {merge(source);}
     void erase(iterator first, iterator second);
+    size_t erase(const Key& key) {return eraseKey_(key, hashFunction_(key));}
+    template<typename K, transparentKey_<K> = 0>
+    size_t erase(const K& key) {return eraseKey_(key, hashFunction_(key));}
     iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    template<typename K, transparentKey_<K> = 0>
+    iterator find(const K& key) {NodePtr found = findNode_(key, hashFunction_(key)); return found ? iterator(subIterator(found)) : end();}
+    template<typename K, transparentKey_<K> = 0>
+    const_iterator find(const K& key) const {NodePtr found = findNode_(key, hashFunction_(key)); return found ? const_iterator(subConstIterator(found)) : cend();}
+    bool contains(const Key& key) const {return findNode_(key, hashFunction_(key));}
+    void find_batch(const Key* keys, size_t count, iterator* out);
+    void find_batch(const Key* keys, size_t count, const_iterator* out) const;
+    void contains_batch(const Key* keys, size_t count, bool* out) const;
+#ifdef HASH_HAS_COROUTINES
+    static constexpr size_t interleaveGroup = 8;
+    void find_interleaved(const Key* keys, size_t count, iterator* out, size_t group = interleaveGroup);
+    void find_interleaved(const Key* keys, size_t count, const_iterator* out, size_t group = interleaveGroup) const;
+    void contains_interleaved(const Key* keys, size_t count, bool* out, size_t group = interleaveGroup) const;
+#endif
+    template<typename K, transparentKey_<K> = 0>
+    bool contains(const K& key) const {return findNode_(key, hashFunction_(key));}
+    size_t count(const Key& key) const {return contains(key);}
+    template<typename K, transparentKey_<K> = 0>
+    size_t count(const K& key) const {return contains(key);}
     void max_load_factor(double alpha);
     void reserve(size_t count);
+    void incremental_rehash(size_t bucketsPerStep);
+    // Growing and reserve() regroup the nodes on up to this many threads, 1 means sequentially.
+    // The resulting table is the same for any number of threads.
+    void parallel_rehash(size_t threads) {rehashThreads_ = threads ? threads : 1;}
+    // Cuts the buckets into parts disjoint ranges of about the same number of buckets, together they
+    // hold every element once. The ranges stay valid until the map is modified.
+    std::vector<bucket_range> split(size_t parts) {return split_<bucket_range>(parts);}
+    std::vector<const_bucket_range> split(size_t parts) const {return split_<const_bucket_range>(parts);}
+    // Call f(element) for every element on up to threads threads, 0 means one per hardware thread.
+    // f may change values but not the map, calls for different elements may run concurrently.
+    template<typename F>
+    void parallel_for_each(F&& f, size_t threads = 0);
+    // Folds every range with accumulate(T, const NodeType&) -> T starting from identity, then folds
+    // the results of the ranges in bucket order with combine(T, T) -> T.
+    template<typename T, typename Accumulate, typename Combine>
+    T parallel_reduce(T identity, Accumulate&& accumulate, Combine&& combine, size_t threads = 0) const;
+    size_t trim() {return listOfNodes.trim();}
+    MapStats stats() const;
+#ifdef HASH_MAP_COUNTERS
+    const MapCounters& counters() const {return counters_;}
+    void reset_counters() {counters_ = MapCounters();}
+#endif
 
 };
 
-template<typename T, typename U, typename H, typename E, typename A>
-std::ostream& operator<<(std::ostream& out, UnorderedMap<T, U, H, E, A>& Table) {
+template<typename T, typename U, typename H, typename E, typename A, typename P>
+std::ostream& operator<<(std::ostream& out, UnorderedMap<T, U, H, E, A, P>& Table) {
     out << std::endl << "This is my table" << std::endl;
-    for (typename UnorderedMap<T, U, H, E, A>::iterator it = Table.begin(); it != Table.end(); ++it) {
+    for (typename UnorderedMap<T, U, H, E, A, P>::iterator it = Table.begin(); it != Table.end(); ++it) {
         out << *it << std::endl;
     }
     out << "End of my table" << std::endl;
     return out;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-bool UnorderedMap<Key, Value, Hash, Equal, Alloc>::theSameHash_(subIterator it, const Key& value) {
-    Hash hashF;
-    size_t curHash = hashF((*it).first);
-    size_t valueHash = hashF(value);
-    return curHash == valueHash;
+// Without a migration in progress the location of a hash is its bucket. During one, the buckets
+// of oldArray_ that are not migrated yet are numbered after the buckets of dataArray_.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::locate_(size_t hash) const {
+    if (!oldArray_) {
+        return bucket_(hash);
+    }
+
+    size_t oldIndex = oldBucketPolicy_.index(hash);
+    if (oldIndex >= migrated_) {
+        return capacity_ + oldIndex;
+    }
+    return bucket_(hash);
+}
+
+// Elements of one bucket are adjacent in listOfNodes, so the walk from the first of them ends at
+// the first node whose hash falls into another bucket.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::NodePtr UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::scanBucket_(NodePtr v, const K& key, size_t hash, size_t index) const {
+    size_t visited = 0;
+    size_t compared = 0;
+    for (; v; v = v->next_) {
+        size_t nodeHash = hashOf_(v);
+        if (locate_(nodeHash) != index) {
+            break;
+        }
+        ++visited;
+        if (nodeHash == hash) {
+            ++compared;
+            if (equalityFunction_(v->data_.first, key)) {
+                countProbe_(true, visited, compared);
+                return v;
+            }
+        }
+    }
+
+    countProbe_(false, visited, compared);
+    return nullptr;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::findBatch_(const Key* keys, size_t count, F&& emit) const {
+    size_t hashes[batchGroup_];
+    size_t locations[batchGroup_];
+    LinkPtr befores[batchGroup_];
+    NodePtr heads[batchGroup_];
+
+    for (size_t first = 0; first < count; first += batchGroup_) {
+        size_t group = std::min(batchGroup_, count - first);
+
+        for (size_t i = 0; i < group; ++i) {
+            hashes[i] = hashFunction_(keys[first + i]);
+            locations[i] = locate_(hashes[i]);
+            prefetchRead(&head_(locations[i]));
+        }
+
+        for (size_t i = 0; i < group; ++i) {
+            befores[i] = head_(locations[i]);
+            if (befores[i]) {
+                prefetchRead(befores[i]);
+            }
+        }
+
+        for (size_t i = 0; i < group; ++i) {
+            heads[i] = befores[i] ? befores[i]->next_ : nullptr;
+            if (heads[i]) {
+                prefetchRead(heads[i]);
+            }
+        }
+
+        for (size_t i = 0; i < group; ++i) {
+            emit(first + i, scanBucket_(heads[i], keys[first + i], hashes[i], locations[i]));
+        }
+    }
+}
+
+// Lookups are done in groups: all keys of a group are hashed and their bucket slots prefetched,
+// then the links before their first nodes, then the first nodes, and only then are the chains
+// compared, so the cache misses of one group overlap instead of following each other.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find_batch(const Key* keys, size_t count, iterator* out) {
+    findBatch_(keys, count, [this, out](size_t i, NodePtr found) {
+        out[i] = found ? iterator(subIterator(found)) : end();
+    });
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find_batch(const Key* keys, size_t count, const_iterator* out) const {
+    findBatch_(keys, count, [this, out](size_t i, NodePtr found) {
+        out[i] = found ? const_iterator(subConstIterator(found)) : cend();
+    });
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::contains_batch(const Key* keys, size_t count, bool* out) const {
+    findBatch_(keys, count, [out](size_t i, NodePtr found) {
+        out[i] = found;
+    });
+}
+
+#ifdef HASH_HAS_COROUTINES
+
+// One task of find_interleaved. It suspends after prefetching the bucket slot, the link before
+// the chain and before every node of the chain, so a long chain costs it more turns instead of stalling the whole group.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+InterleavedTask UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::lookupTask_(const Key* keys, size_t count, size_t& next, F& emit) const {
+    while (next < count) {
+        size_t i = next++;
+        size_t hash = hashFunction_(keys[i]);
+        size_t index = locate_(hash);
+        co_await PrefetchAndSuspend(&head_(index));
+        LinkPtr before = head_(index);
+        if (before) {
+            co_await PrefetchAndSuspend(before);
+        }
+
+        NodePtr found = nullptr;
+        size_t visited = 0;
+        size_t compared = 0;
+        for (NodePtr v = before ? before->next_ : nullptr; v; v = v->next_) {
+            co_await PrefetchAndSuspend(v);
+            size_t nodeHash = hashOf_(v);
+            if (locate_(nodeHash) != index) {
+                break;
+            }
+            ++visited;
+            if (nodeHash == hash) {
+                ++compared;
+                if (equalityFunction_(v->data_.first, keys[i])) {
+                    found = v;
+                    break;
+                }
+            }
+        }
+
+        countProbe_(found, visited, compared);
+        emit(i, found);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::findInterleaved_(const Key* keys, size_t count, size_t group, F&& emit) const {
+    size_t next = 0;
+    runInterleaved(std::max<size_t>(1, std::min(group, count)), [&]() {
+        return lookupTask_(keys, count, next, emit);
+    });
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find_interleaved(const Key* keys, size_t count, iterator* out, size_t group) {
+    findInterleaved_(keys, count, group, [this, out](size_t i, NodePtr found) {
+        out[i] = found ? iterator(subIterator(found)) : end();
+    });
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-bool UnorderedMap<Key, Value, Hash, Equal, Alloc>::theSameHash_(subConstIterator it, const Key& value) {
-    Hash hashF;
-    size_t curHash = hashF((*it).first);
-    size_t valueHash = hashF(value);
-    return curHash == valueHash;
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find_interleaved(const Key* keys, size_t count, const_iterator* out, size_t group) const {
+    findInterleaved_(keys, count, group, [this, out](size_t i, NodePtr found) {
+        out[i] = found ? const_iterator(subConstIterator(found)) : cend();
+    });
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::checkLoad_() {
-    if (load_factor() >= maxLoadFactor_) {
-        rehash_();
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::contains_interleaved(const Key* keys, size_t count, bool* out, size_t group) const {
+    findInterleaved_(keys, count, group, [out](size_t i, NodePtr found) {
+        out[i] = found;
+    });
+}
+
+#endif
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::subIterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::attachNode_(size_t hash, NodePtr node) {
+    if constexpr (cacheHash_) {
+        node->hash_ = hash;
+    }
+    linkFirst_(node, locate_(hash));
+    ++size_;
+    countInsert_();
+    return subIterator(node);
+}
+
+// Makes node the first of its bucket. A new bucket is put at the front of listOfNodes,
+// so the bucket that was first there gets node as the link before it.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::linkFirst_(NodePtr node, size_t location) {
+    LinkPtr& before = head_(location);
+    if (before) {
+        Nodes_::linkAfter(before, node);
+        return;
+    }
+
+    NodePtr front = listOfNodes.first();
+    Nodes_::linkAfter(listOfNodes.beforeBegin(), node);
+    if (front) {
+        head_(locate_(hashOf_(front))) = node;
+    }
+    before = listOfNodes.beforeBegin();
+}
+
+// The bucket of the first node keeps the before-link of listOfNodes, whose address changes
+// when the list moves to another map.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::relinkFront_() {
+    NodePtr front = listOfNodes.first();
+    if (front) {
+        head_(locate_(hashOf_(front))) = listOfNodes.beforeBegin();
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::checkLoad_() {
+    migrateStep_(migrationStep_);
+
+    if (size_ >= maxSize_) {
+        if (migrationStep_) {
+            startMigration_();
+        } else {
+            rehash_();
+        }
+    }
+}
+
+// In incremental mode growing only swaps in a new dataArray_. The following mutating calls zero it
+// in slices, then each moves at most migrationStep_ buckets of oldArray_ into it; lookups check both
+// arrays meanwhile.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::incremental_rehash(size_t bucketsPerStep) {
+    migrationStep_ = bucketsPerStep;
+    if (!migrationStep_) {
+        migrateStep_(oldCapacity_);
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::startMigration_() {
+    migrateStep_(oldCapacity_);
+
+    ++rehashCount_;
+    StopWatch_ watch(rehashSeconds_);
+    oldArray_ = dataArray_;
+    oldBucketPolicy_ = bucketPolicy_;
+    oldCapacity_ = capacity_;
+    migrated_ = 0;
+    capacity_ = bucketPolicy_.reset(capacity_ * resizeMultiply);
+    updateMaxSize_();
+    dataArray_ = new LinkPtr [capacity_];
+    zeroedSlots_ = 0;
+}
+
+// Cuts the run of one old bucket out of listOfNodes and moves its nodes to the front of their
+// new buckets. Neither an unmigrated old bucket nor a new one is ever split by this, so both
+// stay contiguous. migrated_ already counts the bucket, so its nodes are located in dataArray_.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::migrateBucket_(size_t oldIndex) {
+    LinkPtr before = oldArray_[oldIndex];
+    if (!before) {
+        return;
+    }
+    oldArray_[oldIndex] = nullptr;
+
+    NodePtr v = before->next_;
+    NodePtr last = v;
+    while (last->next_ && oldBucketPolicy_.index(hashOf_(last->next_)) == oldIndex) {
+        last = last->next_;
+    }
+    NodePtr rest = last->next_;
+    before->next_ = rest;
+    last->next_ = nullptr;
+    if (rest) {
+        head_(locate_(hashOf_(rest))) = before;
+    }
+
+    while (v) {
+        NodePtr next = v->next_;
+        linkFirst_(v, bucket_(hashOf_(v)));
+        v = next;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::migrateStep_(size_t budget) {
+    if (!oldArray_) {
+        return;
+    }
+    StopWatch_ watch(rehashSeconds_);
+
+    // Until every slot is zeroed no bucket migrates, so no lookup reaches dataArray_.
+    if (zeroedSlots_ < capacity_) {
+        size_t slots = capacity_ - zeroedSlots_;
+        if (budget < oldCapacity_) {
+            slots = std::min(slots, budget * zeroSlotsPerBucket_);
+        }
+        std::fill(dataArray_ + zeroedSlots_, dataArray_ + zeroedSlots_ + slots, nullptr);
+        zeroedSlots_ += slots;
+        if (zeroedSlots_ < capacity_) {
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < budget && migrated_ < oldCapacity_; ++i) {
+        migrateBucket_(migrated_++);
     }
+
+    if (migrated_ == oldCapacity_) {
+        delete[] oldArray_;
+        oldArray_ = nullptr;
+        oldCapacity_ = 0;
+        migrated_ = 0;
+    }
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::updateMaxSize_() {
+    maxSize_ = static_cast<size_t>(std::ceil(static_cast<double>(capacity_) * maxLoadFactor_));
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-double UnorderedMap<Key, Value, Hash, Equal, Alloc>::load_factor() const {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+double UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::load_factor() const {
     double x = static_cast<double>(size_);
     double y = static_cast<double>(capacity_);
     return x / y;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator::operator++() {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator::operator++() {
     ++data;
     return *this;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::max_load_factor(double alpha) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::max_load_factor(double alpha) {
     maxLoadFactor_ = alpha;
+    updateMaxSize_();
     checkLoad_();
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::reserve(size_t count) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::reserve(size_t count) {
     size_t newCount = static_cast<size_t>((static_cast<double>(count) / maxLoadFactor_)) + 1;
     rehash_(newCount);
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator::operator++() {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator::operator++() {
     ++data;
     return *this;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator::operator+=(size_t k) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator::operator+=(size_t k) {
     for (size_t i = 0; i < k; ++i) {
         this->operator++();
     }
@@ -193,321 +987,884 @@ typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator& UnorderedMap<Ke
 }
 
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator::operator+=(size_t k) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator::operator+=(size_t k) {
     for (size_t i = 0; i < k; ++i) {
         this->operator++();
     }
     return *this;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc>::begin() {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::begin() {
     return UnorderedMap::iterator(listOfNodes.begin());
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator UnorderedMap<Key, Value, Hash, Equal, Alloc>::cbegin() const {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::cbegin() const {
     return UnorderedMap::const_iterator(listOfNodes.cbegin());
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::const_iterator UnorderedMap<Key, Value, Hash, Equal, Alloc>::cend() const {
-    return UnorderedMap::const_iterator(listOfNodes.cend());
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::cend() const {
+    return UnorderedMap::const_iterator(subConstIterator());
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc>::end() {
-    return UnorderedMap::iterator(listOfNodes.end());
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::end() {
+    return UnorderedMap::iterator(subIterator());
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap() {
-    dataArray_ = new subIterator [baseSize_];
-    capacity_ = baseSize_;
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::UnorderedMap() {
+    capacity_ = bucketPolicy_.reset(baseSize_);
+    dataArray_ = new LinkPtr [capacity_]();
     size_ = 0;
     maxLoadFactor_ = baseMaxLoadFactor_;
+    updateMaxSize_();
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(const UnorderedMap& other) {
-    dataArray_ = other.dataArray_;
-    listOfNodes = other.listOfNodes;
-    capacity_ = other.capacity_;
-    size_ = other.size_;
-    maxLoadFactor_ = other.maxLoadFactor_;
-}
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::UnorderedMap(const UnorderedMap& other)
+    : maxLoadFactor_(other.maxLoadFactor_), hashFunction_(other.hashFunction_), equalityFunction_(other.equalityFunction_),
+      bucketPolicy_(other.bucketPolicy_), capacity_(other.capacity_), maxSize_(other.maxSize_), migrationStep_(other.migrationStep_),
+      rehashThreads_(other.rehashThreads_) {
+    dataArray_ = new LinkPtr [capacity_]();
+    if (!other.size_) {
+        return;
+    }
 
+    // Unmigrated buckets of other are simply placed by the new policy.
+    for (NodePtr v = other.listOfNodes.first(); v; v = v->next_) {
+        attachNode_(other.hashOf_(v), listOfNodes.createNode(v->data_));
+    }
+}
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>::UnorderedMap(UnorderedMap&& other) {
-    dataArray_ = other.dataArray_;
-    listOfNodes = std::move(other.listOfNodes);
-    capacity_ = other.capacity_;
-    size_ = other.size_;
-    maxLoadFactor_ = other.maxLoadFactor_;
+// A moved-from map may only be destroyed or assigned to.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::UnorderedMap(UnorderedMap&& other)
+    : dataArray_(other.dataArray_), maxLoadFactor_(other.maxLoadFactor_), hashFunction_(std::move(other.hashFunction_)),
+      equalityFunction_(std::move(other.equalityFunction_)), bucketPolicy_(other.bucketPolicy_), size_(other.size_),
+      capacity_(other.capacity_), maxSize_(other.maxSize_), oldArray_(other.oldArray_), oldBucketPolicy_(other.oldBucketPolicy_),
+      oldCapacity_(other.oldCapacity_), migrated_(other.migrated_), migrationStep_(other.migrationStep_), zeroedSlots_(other.zeroedSlots_),
+      rehashThreads_(other.rehashThreads_), rehashCount_(other.rehashCount_), rehashSeconds_(other.rehashSeconds_), listOfNodes(std::move(other.listOfNodes)) {
+#ifdef HASH_MAP_COUNTERS
+    counters_ = other.counters_;
+#endif
     other.dataArray_ = nullptr;
+    other.oldArray_ = nullptr;
     other.size_ = 0;
+    other.oldCapacity_ = 0;
+    relinkFront_();
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>& UnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(const UnorderedMap<Key, Value, Hash, Equal, Alloc>& other) {
-    dataArray_ = other.dataArray_;
-    listOfNodes = other.listOfNodes;
-    capacity_ = other.capacity_;
-    size_ = other.size_;
-    maxLoadFactor_ = other.maxLoadFactor_;
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::operator=(const UnorderedMap& other) {
+    if (this != &other) {
+        UnorderedMap copy(other);
+        *this = std::move(copy);
+    }
     return *this;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>& UnorderedMap<Key, Value, Hash, Equal, Alloc>::operator=(UnorderedMap<Key, Value, Hash, Equal, Alloc>&& other) {
-    dataArray_ = other.dataArray_;
-    listOfNodes = std::move(other.listOfNodes);
-    capacity_ = other.capacity_;
-    size_ = other.size_;
-    maxLoadFactor_ = other.maxLoadFactor_;
-    other.dataArray_ = nullptr;
-    other.size_ = 0;
+// Everything is swapped, so other releases what this map held before.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::operator=(UnorderedMap&& other) {
+    std::swap(dataArray_, other.dataArray_);
+    std::swap(maxLoadFactor_, other.maxLoadFactor_);
+    std::swap(hashFunction_, other.hashFunction_);
+    std::swap(equalityFunction_, other.equalityFunction_);
+    std::swap(bucketPolicy_, other.bucketPolicy_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(maxSize_, other.maxSize_);
+    std::swap(oldArray_, other.oldArray_);
+    std::swap(oldBucketPolicy_, other.oldBucketPolicy_);
+    std::swap(oldCapacity_, other.oldCapacity_);
+    std::swap(migrated_, other.migrated_);
+    std::swap(migrationStep_, other.migrationStep_);
+    std::swap(zeroedSlots_, other.zeroedSlots_);
+    std::swap(rehashThreads_, other.rehashThreads_);
+    std::swap(rehashCount_, other.rehashCount_);
+    std::swap(rehashSeconds_, other.rehashSeconds_);
+#ifdef HASH_MAP_COUNTERS
+    std::swap(counters_, other.counters_);
+#endif
+    std::swap(listOfNodes, other.listOfNodes);
+    relinkFront_();
+    other.relinkFront_();
     return *this;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-UnorderedMap<Key, Value, Hash, Equal, Alloc>::~UnorderedMap() {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::~UnorderedMap() {
     delete[] dataArray_;
+    delete[] oldArray_;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc>::insert(const NodeType& x) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert(const NodeType& x) {
     checkLoad_();
-    size_t indHash = hashFunction_(x.first) % capacity_;
-    subIterator currentNode = dataArray_[indHash];
+    std::pair<subIterator, bool> answer = insertNode_(x);
+    return {iterator(answer.first), answer.second};
+}
 
-    if (!currentNode) {
-        listOfNodes.push_front(x);
-        ++size_;
-        dataArray_[indHash] = listOfNodes.begin();
-        return {listOfNodes.begin(), true};
-    }
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename U>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert(U&& x) {
+    checkLoad_();
+    std::pair<subIterator, bool> answer = insertNode_(std::forward<U>(x));
+    return {iterator(answer.first), answer.second};
+}
 
-    for (subIterator it = currentNode; it != listOfNodes.end() && theSameHash_(it, x.first); ++it) {
-        NodeType& cur = *it;
-        if (equalityFunction_(x.first, cur.first)) {
-            return {iterator(it), false};
-        }
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename U>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::subIterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insertNode_(U&& x) {
+    size_t hash = hashFunction_(x.first);
+    NodePtr found = findNode_(x.first, hash);
+
+    if (found) {
+        return {subIterator(found), false};
     }
 
-    ++size_;
-    subIterator answer = listOfNodes.insert_after_iterator(currentNode, x);
-    return {answer, true};
+    return {linkNode_(hash, std::forward<U>(x)), true};
+}
 
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::erase(iterator it) {
+    migrateStep_(migrationStep_);
+    listOfNodes.destroyNode(detachNode_(it.data.currentNode));
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-template<typename U>
-std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc>::insert(U&& x) {
-    checkLoad_();
-    size_t indHash = hashFunction_(x.first) % capacity_;
-    subIterator currentNode = dataArray_[indHash];
+// Unlinks the node from its bucket and from listOfNodes, leaving it allocated. Its predecessor
+// is found by walking the bucket from the link before it.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::NodePtr UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::detachNode_(NodePtr node) {
+    --size_;
+    countErase_();
+    size_t index = locate_(hashOf_(node));
+    LinkPtr& before = head_(index);
+    LinkPtr prev = before;
+    while (prev->next_ != node) {
+        prev = prev->next_;
+    }
+
+    NodePtr next = node->next_;
+    bool lastOfBucket = !inBucket_(next, index);
+    if (next && lastOfBucket) {
+        head_(locate_(hashOf_(next))) = prev;
+    }
+    if (prev == before && lastOfBucket) {
+        before = nullptr;
+    }
+
+    Nodes_::unlinkAfter(prev);
+    return node;
+}
 
-    if (!currentNode) {
-        subIterator bad(nullptr);
-        listOfNodes.emplace(bad, std::forward<U>(x));
-        ++size_;
-        dataArray_[indHash] = listOfNodes.begin();
-        return {listOfNodes.begin(), true};
+// A stateless Hash gives every map of this type the same value, so a cached one is reused.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::nodeHash_(NodePtr node) const {
+    if constexpr (cacheHash_ && std::is_empty<Hash>::value) {
+        return node->hash_;
+    } else {
+        return hashFunction_(node->data_.first);
     }
+}
 
-    for (subIterator it = currentNode; it != listOfNodes.end() && theSameHash_(it, x.first); ++it) {
-        NodeType& cur = *it;
-        if (equalityFunction_(x.first, cur.first)) {
-            return {iterator(it), false};
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::node_type& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::node_type::operator=(node_type&& other) {
+    if (this != &other) {
+        if (node_) {
+            Nodes_::releaseNode(*alloc_, node_);
+        }
+        alloc_.reset();
+        if (other.alloc_) {
+            alloc_.emplace(std::move(*other.alloc_));
         }
+        node_ = other.release_();
+    }
+    return *this;
+}
+
+// The handle gets a copy of the node allocator. If the copy cannot free the map's nodes,
+// as with the per-object pools of FastAllocator, the element moves into a node of the copy.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::node_type UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::extract(const_iterator it) {
+    migrateStep_(migrationStep_);
+    NodePtr node = subIterator(it.data).currentNode;
+    typename node_type::nodeAllocator_ alloc = listOfNodes.getNodeAllocator();
+    if (listOfNodes.sharesNodes(alloc)) {
+        return node_type(detachNode_(node), std::move(alloc));
     }
 
-    ++size_;
-    subIterator answer = listOfNodes.emplace(currentNode, std::forward<U>(x));
-    return {answer, true};
+    NodePtr copy = Nodes_::allocateNode(alloc, std::move(node->data_));
+    if constexpr (cacheHash_) {
+        copy->hash_ = node->hash_;
+    }
+    listOfNodes.destroyNode(detachNode_(node));
+    return node_type(copy, std::move(alloc));
+}
 
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::node_type UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::extract(const Key& key) {
+    NodePtr found = findNode_(key, hashFunction_(key));
+    if (!found) {
+        return node_type();
+    }
+    return extract(const_iterator(subConstIterator(found)));
 }
 
+// The node is relinked as is when both lists allocate alike, otherwise its element is moved
+// into a node of this map. On a duplicate key the handle is given back untouched.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert_return_type UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert(node_type&& handle) {
+    insert_return_type answer;
+    if (!handle) {
+        answer.position = end();
+        return answer;
+    }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::erase(iterator it) {
-    --size_;
-    size_t curHash = hashFunction_((*it).first) % capacity_;
-    subIterator mainIter = dataArray_[curHash];
-    if (mainIter != it.data) {
-        listOfNodes.erase(it.data);
+    checkLoad_();
+    size_t hash = nodeHash_(handle.node_);
+    NodePtr found = findNode_(handle.key(), hash);
+
+    if (found) {
+        answer.position = iterator(subIterator(found));
+        answer.node = std::move(handle);
+        return answer;
+    }
+
+    answer.inserted = true;
+    if (listOfNodes.sharesNodes(*handle.alloc_)) {
+        answer.position = iterator(attachNode_(hash, handle.release_()));
     } else {
-        iterator anotherIt = it + 1;
-        if (anotherIt.data == listOfNodes.end() || !theSameHash_(anotherIt.data, (*it).first)) {
-            dataArray_[curHash] = subIterator(nullptr);
-            listOfNodes.erase(mainIter);
-        } else {
-            dataArray_[curHash] = anotherIt.data;
-            listOfNodes.erase(mainIter);
+        answer.position = iterator(linkNode_(hash, std::move(handle.node_->data_)));
+        handle = node_type();
+    }
+    return answer;
+}
+
+// Moves every element whose key is absent here out of source; duplicates stay in source.
+// With compatible allocators the nodes themselves are spliced, so nothing is allocated,
+// copied or hashed again for a stateless Hash.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::merge(UnorderedMap& source) {
+    if (&source == this || !source.size_) {
+        return;
+    }
+
+    source.migrateStep_(source.oldCapacity_);
+    reserve(size_ + source.size_);
+    bool splice = listOfNodes.sharesNodes(source.listOfNodes);
+    NodePtr v = source.listOfNodes.first();
+
+    while (v) {
+        NodePtr next = v->next_;
+        size_t hash = nodeHash_(v);
+
+        if (!findNode_(v->data_.first, hash)) {
+            source.detachNode_(v);
+            checkLoad_();
+            if (splice) {
+                attachNode_(hash, v);
+            } else {
+                linkNode_(hash, std::move(v->data_));
+                source.listOfNodes.destroyNode(v);
+            }
         }
+
+        v = next;
     }
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::erase(iterator first, iterator second) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::eraseKey_(const K& key, size_t hash) {
+    NodePtr found = findNode_(key, hash);
+    if (!found) {
+        return 0;
+    }
+    erase(iterator(subIterator(found)));
+    return 1;
+}
 
-    for (; first != second; ++first) {
-        erase(first);
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::erase(iterator first, iterator second) {
+    // A migration step reorders the list, so the whole range is detached before the map migrates.
+    while (first != second) {
+        iterator next = first;
+        ++next;
+        listOfNodes.destroyNode(detachNode_(first.data.currentNode));
+        first = next;
     }
+    migrateStep_(migrationStep_);
+}
 
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename Iter>
+UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::UnorderedMap(Iter first, Iter last, size_t threads) : UnorderedMap() {
+    if constexpr (std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iter>::iterator_category>::value) {
+        size_t count = static_cast<size_t>(last - first);
+        threads = std::min(threads, count / parallelRehashGrain_);
+        if (threads > 1) {
+            reserve(count);
+            buildParallel_(first, count, threads);
+            return;
+        }
+    }
+    insert(first, last);
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+// A forward range is counted first, so the buckets are reserved once and no element checks the load.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
 template<typename Iter>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::insert(Iter first, Iter second) {
-    for (Iter it = first; it != second; ++it) {
-        insert(*it);
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insert(Iter first, Iter second) {
+    if constexpr (std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<Iter>::iterator_category>::value) {
+        migrateStep_(oldCapacity_);
+        reserve(size_ + static_cast<size_t>(std::distance(first, second)));
+        for (Iter it = first; it != second; ++it) {
+            insertNode_(*it);
+        }
+    } else {
+        for (Iter it = first; it != second; ++it) {
+            insert(*it);
+        }
     }
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::rehash_(size_t newSize) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::rehash_(size_t newSize) {
+    migrateStep_(oldCapacity_);
+
+    BucketPolicy policy = bucketPolicy_;
+    size_t capacity;
     if (!newSize) {
-        capacity_ *= resizeMultiply;
+        capacity = policy.reset(capacity_ * resizeMultiply);
     } else {
-        if (newSize < capacity_) {
+        if (newSize <= capacity_) {
             return;
         }
-        capacity_ = newSize;
+        capacity = policy.reset(newSize);
+    }
+    ++rehashCount_;
+    StopWatch_ watch(rehashSeconds_);
+
+    size_t threads = std::min(rehashThreads_, size_ / parallelRehashGrain_);
+    std::vector<NodePtr> order(threads > 1 ? size_ : 0);
+    LinkPtr* oldArray = dataArray_;
+    size_t oldCapacity = capacity_;
+    BucketPolicy oldPolicy = bucketPolicy_;
+    dataArray_ = new LinkPtr [capacity]();
+    bucketPolicy_ = policy;
+    capacity_ = capacity;
+    updateMaxSize_();
+
+    if (listOfNodes.first()) {
+        if (threads > 1) {
+            regroupParallel_(oldArray, oldCapacity, oldPolicy, threads, order);
+        } else {
+            regroup_(oldArray, oldCapacity, oldPolicy);
+        }
+    }
+    delete[] oldArray;
+}
+
+// Turns the slots first..last-1 of array from the links before their buckets into the first nodes.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::firstNodes_(LinkPtr* array, size_t first, size_t last) {
+    for (size_t k = first; k < last; ++k) {
+        if (array[k]) {
+            array[k] = array[k]->next_;
+        }
     }
+}
 
-    List<subIterator>* ar = new List<subIterator> [capacity_];
-    for (iterator it = begin(); it != end(); ++it) {
-        size_t tempHash = hashFunction_((*it).first);
-        ar[tempHash % capacity_].push_back(it.data);
+// Calls f for every node of the old buckets first..last-1, bucket after bucket, once their slots
+// hold the first nodes. f may not change the nodes.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::forEachRun_(LinkPtr* array, size_t first, size_t last, const BucketPolicy& policy, F&& f) const {
+    for (size_t k = first; k < last; ++k) {
+        if (k + rehashPrefetch_ < last) {
+            prefetchRead(array[k + rehashPrefetch_]);
+        }
+        for (NodePtr v = static_cast<NodePtr>(array[k]); v && policy.index(hashOf_(v)) == k; v = v->next_) {
+            f(v);
+        }
     }
+}
 
-    delete[] dataArray_;
-    dataArray_ = new subIterator [capacity_];
+// Links the nodes in the order of their new buckets. Within a new bucket they keep the order of
+// their old buckets, so the result depends on the contents of the buckets only.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::regroup_(LinkPtr* oldArray, size_t oldCapacity, const BucketPolicy& oldPolicy) {
+    firstNodes_(oldArray, 0, oldCapacity);
+
+    // First pass: collect the nodes into a chain per new bucket. A node's next_ is read before it is
+    // overwritten, and the run of an old bucket ends at a node of another bucket or the end.
+    for (size_t k = 0; k < oldCapacity; ++k) {
+        if (k + rehashPrefetch_ < oldCapacity) {
+            prefetchRead(oldArray[k + rehashPrefetch_]);
+        }
+        for (NodePtr v = static_cast<NodePtr>(oldArray[k]); v; ) {
+            size_t hash = hashOf_(v);
+            if (oldPolicy.index(hash) != k) {
+                break;
+            }
+            NodePtr next = v->next_;
+            appendToChain_(dataArray_[bucket_(hash)], v);
+            v = next;
+        }
+    }
 
-    for (size_t i = 0; i < capacity_; ++i) {
-        if (!ar[i].begin()) {
-            continue;
+    // Second pass: link the chains back in bucket order.
+    listOfNodes.beforeBegin()->next_ = nullptr;
+    linkShares_({linkShare_(0, 1)});
+}
+
+// The same regrouping on several threads. Thread t reads the old buckets of its t-th share and
+// thread u owns the u-th share of the new ones. Every thread counts how many of its nodes go to
+// each share, a prefix sum over the counts gives each (share, thread) pair a range of order,
+// the threads scatter their nodes there, then every owner chains and links its share alone.
+// Shares are taken in ascending order everywhere, so the result matches regroup_.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::regroupParallel_(LinkPtr* oldArray, size_t oldCapacity, const BucketPolicy& oldPolicy, size_t threads,
+                                                                             std::vector<NodePtr>& order) {
+    auto oldShare = [oldCapacity, threads](size_t t) {return oldCapacity * t / threads;};
+
+    std::vector<size_t> offsets(threads * threads, 0);
+    runThreads_(threads, [&](size_t t) {
+        firstNodes_(oldArray, oldShare(t), oldShare(t + 1));
+        forEachRun_(oldArray, oldShare(t), oldShare(t + 1), oldPolicy, [&](NodePtr v) {
+            ++offsets[t * threads + shareOwner_(bucket_(hashOf_(v)), threads)];
+        });
+    });
+    std::vector<size_t> starts = prefixShares_(offsets, threads);
+
+    runThreads_(threads, [&](size_t t) {
+        forEachRun_(oldArray, oldShare(t), oldShare(t + 1), oldPolicy, [&](NodePtr v) {
+            order[offsets[t * threads + shareOwner_(bucket_(hashOf_(v)), threads)]++] = v;
+        });
+    });
+
+    std::vector<Share_> shares(threads);
+    runThreads_(threads, [&](size_t u) {
+        for (size_t i = starts[u]; i < starts[u + 1]; ++i) {
+            if (i + rehashPrefetch_ < starts[u + 1]) {
+                prefetchRead(order[i + rehashPrefetch_]);
+            }
+            appendToChain_(dataArray_[bucket_(hashOf_(order[i]))], order[i]);
+        }
+        shares[u] = linkShare_(u, threads);
+    });
+
+    listOfNodes.beforeBegin()->next_ = nullptr;
+    linkShares_(shares);
+}
+
+// Same scheme as regroupParallel_ with elements of the range instead of old buckets. An owner skips
+// an element whose key is already in its bucket, so the first of equal keys wins as with insert.
+// Nodes are built on the owners' threads only if the allocator has no per-object state.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename Iter>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::buildParallel_(Iter first, size_t count, size_t threads) {
+    auto slice = [count, threads](size_t t) {return count * t / threads;};
+    std::vector<size_t> hashes(count);
+    std::vector<size_t> order(count);
+
+    std::vector<size_t> offsets(threads * threads, 0);
+    runThreads_(threads, [&](size_t t) {
+        for (size_t i = slice(t); i < slice(t + 1); ++i) {
+            hashes[i] = hashFunction_(first[i].first);
+            ++offsets[t * threads + shareOwner_(bucket_(hashes[i]), threads)];
+        }
+    });
+    std::vector<size_t> starts = prefixShares_(offsets, threads);
+
+    runThreads_(threads, [&](size_t t) {
+        for (size_t i = slice(t); i < slice(t + 1); ++i) {
+            order[offsets[t * threads + shareOwner_(bucket_(hashes[i]), threads)]++] = i;
+        }
+    });
+
+    std::vector<Share_> shares(threads);
+    std::vector<size_t> sizes(threads, 0);
+    std::vector<std::exception_ptr> errors(threads);
+    auto build = [&](size_t u) {
+        try {
+            for (size_t j = starts[u]; j < starts[u + 1]; ++j) {
+                size_t i = order[j];
+                LinkPtr& slot = dataArray_[bucket_(hashes[i])];
+                bool found = false;
+                for (NodePtr v = slot ? slot->next_ : nullptr; v && !found; v = v == slot ? nullptr : v->next_) {
+                    found = (!cacheHash_ || hashOf_(v) == hashes[i]) && equalityFunction_(v->data_.first, first[i].first);
+                }
+                if (!found) {
+                    NodePtr node = listOfNodes.createNode(first[i]);
+                    if constexpr (cacheHash_) {
+                        node->hash_ = hashes[i];
+                    }
+                    appendToChain_(slot, node);
+                    ++sizes[u];
+                }
+            }
+        } catch (...) {
+            errors[u] = std::current_exception();
+        }
+        shares[u] = linkShare_(u, threads);
+    };
+    if (std::allocator_traits<typename Nodes_::nodeAllocator>::is_always_equal::value) {
+        runThreads_(threads, build);
+    } else {
+        for (size_t u = 0; u < threads; ++u) {
+            build(u);
         }
-        dataArray_[i] = *ar[i].begin();
     }
 
-    typename List<NodeType, Alloc>::Node* v = listOfNodes.first();
-    for (size_t i = 0; i < capacity_; ++i) {
-        for (typename List<subIterator>::iterator j = ar[i].begin(); j != ar[i].end(); ++j) {
-            v->setSubsequent((*j).currentNode);
-            v = (*j).currentNode;
+    linkShares_(shares);
+    for (size_t u = 0; u < threads; ++u) {
+        size_ += sizes[u];
+    }
+
+    for (std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
+}
 
-    if (v) {
-        v->setSubsequent(listOfNodes.end().currentNode);
+// Runs f(0), ..., f(threads - 1) in parallel and rethrows the first exception after all of them end.
+// If a thread cannot be started, its part runs on the calling thread.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::runThreads_(size_t threads, F&& f) {
+    std::vector<std::exception_ptr> errors(threads);
+    auto guarded = [&f, &errors](size_t t) {
+        try {
+            f(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        try {
+            workers.emplace_back(guarded, t);
+        } catch (const std::system_error&) {
+            guarded(t);
+        }
+    }
+    guarded(0);
+    for (std::thread& worker : workers) {
+        worker.join();
     }
 
+    for (std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc>::find(const Key& key) {
-    checkLoad_();
-    size_t curHash = hashFunction_(key) % capacity_;
-    subIterator mainIter = dataArray_[curHash];
+// offsets[t * threads + u] counts what thread t sends to share u. Replaces the counts with the
+// first position of each pair, shares ascending and threads ascending within a share, and returns
+// where every share starts.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+std::vector<size_t> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::prefixShares_(std::vector<size_t>& offsets, size_t threads) {
+    std::vector<size_t> starts(threads + 1, 0);
+    size_t sum = 0;
+    for (size_t u = 0; u < threads; ++u) {
+        starts[u] = sum;
+        for (size_t t = 0; t < threads; ++t) {
+            size_t count = offsets[t * threads + u];
+            offsets[t * threads + u] = sum;
+            sum += count;
+        }
+    }
+    starts[threads] = sum;
+    return starts;
+}
+
+// Appends v to the circular chain of a bucket, whose slot points to the last node meanwhile.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::appendToChain_(LinkPtr& slot, NodePtr v) {
+    if (!slot) {
+        v->next_ = v;
+    } else {
+        v->next_ = slot->next_;
+        slot->next_ = v;
+    }
+    slot = v;
+}
 
-    if (!mainIter) {
-        return end();
+// Opens and joins the chains of the buckets of one share. Every bucket but the first one gets the
+// last node before it, the first one is left for linkShares_.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::Share_ UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::linkShare_(size_t share, size_t threads) {
+    Share_ answer;
+    for (size_t i = shareStart_(share, threads); i < shareStart_(share + 1, threads); ++i) {
+        if (!dataArray_[i]) {
+            continue;
+        }
+        NodePtr last = static_cast<NodePtr>(dataArray_[i]);
+        NodePtr first = last->next_;
+        last->next_ = nullptr;
+        if (answer.last) {
+            answer.last->next_ = first;
+            dataArray_[i] = answer.last;
+        } else {
+            answer.first = first;
+            answer.firstBucket = i;
+        }
+        answer.last = last;
+    }
+    return answer;
+}
+
+// Puts the shares at the front of listOfNodes in order, before whatever it still holds.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::linkShares_(const std::vector<Share_>& shares) {
+    NodePtr rest = listOfNodes.first();
+    LinkPtr last = listOfNodes.beforeBegin();
+    for (const Share_& share : shares) {
+        if (share.first) {
+            last->next_ = share.first;
+            dataArray_[share.firstBucket] = last;
+            last = share.last;
+        }
     }
+    last->next_ = rest;
+    if (rest) {
+        head_(locate_(hashOf_(rest))) = last;
+    }
+}
 
-    for (subIterator it = mainIter; it != listOfNodes.end() && theSameHash_(it, key); ++it) {
-        NodeType& cur = *it;
-        if (equalityFunction_(cur.first, key)) {
-            return iterator(it);
+// Walks every node once: buckets are contiguous runs of listOfNodes, so each run is one chain.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+MapStats UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::stats() const {
+    MapStats answer;
+    answer.size = size_;
+    answer.bucketCount = capacity_ + (oldArray_ ? oldCapacity_ - migrated_ : 0);
+    answer.chainHistogram.assign(1, 0);
+    answer.rehashCount = rehashCount_;
+    answer.rehashSeconds = rehashSeconds_;
+
+    size_t chains = 0;
+    double hitProbes = 0;
+    for (NodePtr v = listOfNodes.first(); v;) {
+        size_t location = locate_(hashOf_(v));
+        size_t length = 0;
+        for (; inBucket_(v, location); v = v->next_) {
+            ++length;
         }
+
+        if (answer.chainHistogram.size() <= length) {
+            answer.chainHistogram.resize(length + 1, 0);
+        }
+        ++answer.chainHistogram[length];
+        answer.maxChain = std::max(answer.maxChain, length);
+        hitProbes += static_cast<double>(length) * static_cast<double>(length + 1) / 2;
+        ++chains;
+    }
+
+    answer.chainHistogram[0] = answer.bucketCount - chains;
+    if (answer.bucketCount) {
+        answer.emptyBucketFraction = static_cast<double>(answer.chainHistogram[0]) / static_cast<double>(answer.bucketCount);
+        answer.averageMissProbes = static_cast<double>(size_) / static_cast<double>(answer.bucketCount);
+    }
+    if (size_) {
+        answer.averageHitProbes = hitProbes / static_cast<double>(size_);
     }
 
-    return end();
+    answer.bucketBytes = (capacity_ + oldCapacity_) * sizeof(LinkPtr);
+    answer.nodeBytes = size_ * sizeof(typename Nodes_::Node);
+    size_t reserved = listOfNodes.reservedBytes(size_);
+    answer.allocatorSlackBytes = reserved > answer.nodeBytes ? reserved - answer.nodeBytes : 0;
+    return answer;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-Value& UnorderedMap<Key, Value, Hash, Equal, Alloc>::operator[](const Key& key) {
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find(const Key& key) {
+    NodePtr found = findNode_(key, hashFunction_(key));
+    return found ? iterator(subIterator(found)) : end();
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::const_iterator UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::find(const Key& key) const {
+    NodePtr found = findNode_(key, hashFunction_(key));
+    return found ? const_iterator(subConstIterator(found)) : cend();
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K>
+Value& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::subscript_(K&& key) {
     checkLoad_();
-    size_t curHash = hashFunction_(key) % capacity_;
-    subIterator mainIter = dataArray_[curHash];
+    size_t hash = hashFunction_(key);
+    NodePtr found = findNode_(key, hash);
 
-    if (!mainIter) {
-        listOfNodes.push_front({key, Value()});
-        ++size_;
-        dataArray_[curHash] = listOfNodes.begin();
-        return (*dataArray_[curHash]).second;
+    if (found) {
+        return found->data_.second;
     }
 
-    for (subIterator it = mainIter; it != listOfNodes.end() && theSameHash_(it, key); ++it) {
-        NodeType& cur = *it;
-        if (equalityFunction_(cur.first, key)) {
-            return cur.second;
-        }
+    return (*linkNode_(hash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::tuple<>())).second;
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K, typename... Args>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::tryEmplace_(size_t hash, K&& key, Args&&... args) {
+    checkLoad_();
+    NodePtr found = findNode_(key, hash);
+
+    if (found) {
+        return {iterator(subIterator(found)), false};
     }
 
-    ++size_;
-    subIterator it = listOfNodes.insert_after_iterator(mainIter, {key, Value()});
-    return (*it).second;
+    return {iterator(linkNode_(hash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...))), true};
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-Value& UnorderedMap<Key, Value, Hash, Equal, Alloc>::at(const Key& key) {
-    iterator it = find(key);
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K, typename M>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::insertOrAssign_(size_t hash, K&& key, M&& value) {
+    checkLoad_();
+    NodePtr found = findNode_(key, hash);
 
-    if (it == end()) {
-        throw std::out_of_range("No Key");
+    if (found) {
+        found->data_.second = std::forward<M>(value);
+        return {iterator(subIterator(found)), false};
     }
 
-    return (*it).second;
+    return {iterator(linkNode_(hash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<M>(value)))), true};
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename K>
+Value& UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::at_(const K& key) {
+    NodePtr found = findNode_(key, hashFunction_(key));
 
+    if (!found) {
+        throw std::out_of_range("No Key");
+    }
+
+    return found->data_.second;
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
 template<typename... Args>
-std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc>::emplace(Args&&... args) {
-
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::iterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::emplace(Args&&... args) {
     checkLoad_();
-    NodeType* x = allocateNode_(std::forward<Args>(args)...);
-    size_t indHash = hashFunction_(x->first);
-    subIterator currentNode = dataArray_[indHash % capacity_];
-    subIterator badIter = subIterator(nullptr);
+    std::pair<subIterator, bool> answer = emplaceNode_(std::forward<Args>(args)...);
+    return {iterator(answer.first), answer.second};
+}
 
-    if (!currentNode) {
-        listOfNodes.emplace(badIter, std::forward<Args>(args)...);
-        ++size_;
-        dataArray_[indHash % capacity_] = listOfNodes.begin();
-        return {listOfNodes.begin(), true};
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename... Args>
+std::pair<typename UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::subIterator, bool> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::emplaceNode_(Args&&... args) {
+    NodePtr node = listOfNodes.createNode(std::forward<Args>(args)...);
+    size_t hash = hashFunction_(node->data_.first);
+    NodePtr found = findNode_(node->data_.first, hash);
+
+    if (found) {
+        listOfNodes.destroyNode(node);
+        return {subIterator(found), false};
     }
 
-    for (subIterator it = currentNode; it != listOfNodes.end() && theSameHash_(it, x->first); ++it) {
-        NodeType& cur = *it;
-        if (equalityFunction_(x->first, cur.first)) {
-            return {iterator(it), false};
+    return {attachNode_(hash, node), true};
+}
+
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename Make>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::emplace_n(size_t count, Make&& make) {
+    migrateStep_(oldCapacity_);
+    size_t reserved = std::min(count, emplaceReserveLimit_);
+    reserve(size_ + reserved);
+    auto construct = [this](auto&&... args) {
+        emplaceNode_(std::forward<decltype(args)>(args)...);
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i >= reserved) {
+            checkLoad_();
         }
+        make(construct);
     }
+}
 
-    deallocateNode_(x);
-    ++size_;
-    subIterator answer = listOfNodes.emplace(currentNode, std::forward<Args>(args)...);
-    return {iterator(answer), true};
+// Small maps are scanned on fewer threads, every thread gets at least parallelScanGrain_ elements.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+size_t UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::scanThreads_(size_t threads) const {
+    if (!threads) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    return std::max<size_t>(std::min(threads, size_ / parallelScanGrain_), 1);
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-template<typename... Args>
-typename UnorderedMap<Key, Value, Hash, Equal, Alloc>::NodeType* UnorderedMap<Key, Value, Hash, Equal, Alloc>::allocateNode_(Args&& ...args) {
-    NodeType* ptr = std::allocator_traits<Alloc>::allocate(alloc_, 1);
-    std::allocator_traits<Alloc>::construct(alloc_, ptr, std::forward<Args>(args)...);
-    return ptr;
+// During a migration the buckets of oldArray_ not migrated yet are ranges' locations as well,
+// the migrated ones are empty.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename Range>
+std::vector<Range> UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::split_(size_t parts) const {
+    size_t locations = capacity_ + (oldArray_ ? oldCapacity_ : 0);
+    parts = std::max<size_t>(std::min(parts, locations), 1);
+    std::vector<Range> ranges;
+    ranges.reserve(parts);
+    for (size_t u = 0; u < parts; ++u) {
+        ranges.push_back(Range(this, locations * u / parts, locations * (u + 1) / parts));
+    }
+    return ranges;
+}
+
+// Threads take the ranges one at a time in order, so the ranges of a slow thread go to the others.
+// After an exception the ranges left are not taken.
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename Range, typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::scanRanges_(const std::vector<Range>& ranges, size_t threads, F&& f) {
+    std::atomic<size_t> next(0);
+    runThreads_(std::min(threads, ranges.size()), [&](size_t) {
+        try {
+            for (size_t r = next++; r < ranges.size(); r = next++) {
+                f(r, ranges[r]);
+            }
+        } catch (...) {
+            next = ranges.size();
+            throw;
+        }
+    });
 }
 
-template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc>
-void UnorderedMap<Key, Value, Hash, Equal, Alloc>::deallocateNode_(NodeType* ptr) {
-    std::allocator_traits<Alloc>::destroy(alloc_, ptr);
-    std::allocator_traits<Alloc>::deallocate(alloc_, ptr, 1);
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename F>
+void UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::parallel_for_each(F&& f, size_t threads) {
+    threads = scanThreads_(threads);
+    std::vector<bucket_range> ranges = split(threads == 1 ? 1 : threads * scanRangesPerThread_);
+    scanRanges_(ranges, threads, [&f](size_t, const bucket_range& range) {
+        for (NodeType& element : range) {
+            f(element);
+        }
+    });
 }
 
+template<typename Key, typename Value, typename Hash, typename Equal, typename Alloc, typename BucketPolicy>
+template<typename T, typename Accumulate, typename Combine>
+T UnorderedMap<Key, Value, Hash, Equal, Alloc, BucketPolicy>::parallel_reduce(T identity, Accumulate&& accumulate, Combine&& combine, size_t threads) const {
+    threads = scanThreads_(threads);
+    std::vector<const_bucket_range> ranges = split(threads == 1 ? 1 : threads * scanRangesPerThread_);
+    std::vector<T> partial(ranges.size(), identity);
+    scanRanges_(ranges, threads, [&accumulate, &partial](size_t r, const const_bucket_range& range) {
+        T answer = std::move(partial[r]);
+        for (const NodeType& element : range) {
+            answer = accumulate(std::move(answer), element);
+        }
+        partial[r] = std::move(answer);
+    });
 
+    T answer = std::move(identity);
+    for (T& value : partial) {
+        answer = combine(std::move(answer), std::move(value));
+    }
+    return answer;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Helpers shared by the benchmarks: a timer, reproducible keys, allocation and memory
+// counters (Bench.cpp) and one CSV line per result.
+
+class Timer {
+private:
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+public:
+    void reset() {start_ = std::chrono::steady_clock::now();}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+};
+
+// Number of global operator new calls so far in this process.
+size_t allocationCount();
+
+// Peak resident set size of this process in KiB, 0 where it is unknown.
+size_t peakRssKb();
+
+inline uint64_t splitMix(uint64_t& state) {
+    uint64_t x = (state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline std::vector<uint64_t> randomKeys(size_t count, uint64_t seed) {
+    std::vector<uint64_t> keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = splitMix(seed);
+    }
+    return keys;
+}
+
+inline size_t sizeArgument(int argc, char** argv, int index, size_t fallback) {
+    return argc > index ? static_cast<size_t>(std::strtoull(argv[index], nullptr, 10)) : fallback;
+}
+
+inline void reportHeader() {
+    std::printf("benchmark,container,key,distribution,size,ns_per_op,allocs_per_op,peak_rss_kb\n");
+    std::fflush(stdout);
+}
+
+class Result {
+public:
+    std::string benchmark;
+    std::string container;
+    std::string key = "uint64";
+    std::string distribution = "uniform";
+    size_t size = 0;
+    double seconds = 0;
+    size_t ops = 1;
+    size_t allocations = 0;
+};
+
+inline void report(const Result& result) {
+    double ops = static_cast<double>(result.ops);
+    std::printf("%s,%s,%s,%s,%zu,%.2f,%.3f,%zu\n", result.benchmark.c_str(), result.container.c_str(),
+                result.key.c_str(), result.distribution.c_str(), result.size, result.seconds * 1e9 / ops,
+                static_cast<double>(result.allocations) / ops, peakRssKb());
+    std::fflush(stdout);
+}
+
+// Times f(), which performs ops operations, and counts the allocations it makes.
+template<typename F>
+Result measure(const std::string& benchmark, const std::string& container, size_t size, size_t ops, F&& f) {
+    Result result;
+    result.benchmark = benchmark;
+    result.container = container;
+    result.size = size;
+    result.ops = ops ? ops : 1;
+    size_t allocations = allocationCount();
+    Timer timer;
+    f();
+    result.seconds = timer.seconds();
+    result.allocations = allocationCount() - allocations;
+    return result;
+}
+
+// Keeps the optimizer from dropping a computed value.
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
@@ -0,0 +1,158 @@
+// Builds every map engine of the repository from the same 64-bit keys and times hit and miss
+// lookups on it: UnorderedMap, FlatMap, SmallMap, ConcurrentMap, ReadMostlyMap (through a
+// reader), MappedMap (from a snapshot file) and FrozenMap. FrozenMap has its size fixed at
+// compile time, so it only runs for the sizes it is instantiated with below.
+//
+// Usage: engine_bench [sizes, default 8,4096,1000000]
+
+#include "UnMap.cpp"
+#include "FlatMap.cpp"
+#include "SmallMap.cpp"
+#include "ConcurrentMap.cpp"
+#include "ReadMostlyMap.cpp"
+#include "MappedMap.cpp"
+#include "FrozenMap.cpp"
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+class Workload {
+public:
+    size_t size = 0;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> misses;
+
+    explicit Workload(size_t count) : size(count) {
+        std::vector<uint64_t> all = randomKeys(2 * count, 1);
+        keys.assign(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(count));
+        size_t lookups = std::min(std::max(count, static_cast<size_t>(1) << 20), static_cast<size_t>(1) << 22);
+        hits.resize(lookups);
+        misses.resize(lookups);
+        uint64_t state = 2;
+        for (size_t i = 0; i < lookups; ++i) {
+            size_t index = splitMix(state) % count;
+            hits[i] = all[index];
+            misses[i] = all[count + index];
+        }
+    }
+};
+
+// Reports build, lookup_hit and lookup_miss of one engine. build(keys) returns the engine,
+// contains(engine, key) looks a key up.
+template<typename Build, typename Contains>
+void runEngine(const std::string& container, const Workload& work, Build&& build, Contains&& contains) {
+    size_t allocations = allocationCount();
+    Timer timer;
+    auto engine = build(work.keys);
+    Result built;
+    built.benchmark = "build";
+    built.container = container;
+    built.size = work.size;
+    built.ops = work.size;
+    built.seconds = timer.seconds();
+    built.allocations = allocationCount() - allocations;
+    report(built);
+
+    size_t found = 0;
+    report(measure("lookup_hit", container, work.size, work.hits.size(), [&]() {
+        for (uint64_t key : work.hits) {
+            found += contains(*engine, key);
+        }
+    }));
+    report(measure("lookup_miss", container, work.size, work.misses.size(), [&]() {
+        for (uint64_t key : work.misses) {
+            found += contains(*engine, key);
+        }
+    }));
+    if (found != work.hits.size()) {
+        std::fprintf(stderr, "%s found %zu of %zu keys\n", container.c_str(), found, work.hits.size());
+    }
+}
+
+template<typename Map>
+std::unique_ptr<Map> buildByIndex(const std::vector<uint64_t>& keys) {
+    std::unique_ptr<Map> map(new Map());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        (*map)[keys[i]] = i;
+    }
+    return map;
+}
+
+template<size_t N>
+void runFrozen(const Workload& work) {
+    if (work.size != N) {
+        return;
+    }
+    using Map = FrozenMap<uint64_t, uint64_t, N>;
+    runEngine("FrozenMap", work, [](const std::vector<uint64_t>& keys) {
+        std::unique_ptr<typename Map::NodeType[][N]> elements(new typename Map::NodeType[1][N]);
+        for (size_t i = 0; i < N; ++i) {
+            elements[0][i] = {keys[i], i};
+        }
+        return std::unique_ptr<Map>(new Map(elements[0]));
+    }, [](const Map& map, uint64_t key) {return map.contains(key);});
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {8, 4096, 1000000};
+    if (argc > 1) {
+        sizes.clear();
+        for (const char* c = argv[1]; *c;) {
+            char* end = nullptr;
+            sizes.push_back(static_cast<size_t>(std::strtoull(c, &end, 10)));
+            c = *end ? end + 1 : end;
+        }
+    }
+    std::string snapshot = (std::filesystem::temp_directory_path() / ("engine_bench." + std::to_string(getpid()))).string();
+
+    reportHeader();
+    for (size_t size : sizes) {
+        Workload work(size);
+
+        runEngine("UnorderedMap", work, buildByIndex<UnorderedMap<uint64_t, uint64_t> >,
+                  [](const UnorderedMap<uint64_t, uint64_t>& map, uint64_t key) {return map.contains(key);});
+
+        runEngine("FlatMap", work, buildByIndex<FlatMap<uint64_t, uint64_t> >,
+                  [](const FlatMap<uint64_t, uint64_t>& map, uint64_t key) {return map.find(key) != map.cend();});
+
+        runEngine("SmallMap", work, buildByIndex<SmallMap<uint64_t, uint64_t> >,
+                  [](const SmallMap<uint64_t, uint64_t>& map, uint64_t key) {return map.contains(key);});
+
+        runEngine("ConcurrentMap", work, [](const std::vector<uint64_t>& keys) {
+            std::unique_ptr<ConcurrentMap<uint64_t, uint64_t> > map(new ConcurrentMap<uint64_t, uint64_t>());
+            for (size_t i = 0; i < keys.size(); ++i) {
+                map->insert(keys[i], i);
+            }
+            return map;
+        }, [](const ConcurrentMap<uint64_t, uint64_t>& map, uint64_t key) {return map.contains(key);});
+
+        using ReadMostly = ReadMostlyMap<uint64_t, uint64_t>;
+        std::unique_ptr<ReadMostly> readMostly(new ReadMostly());
+        runEngine("ReadMostlyMap", work, [&readMostly](const std::vector<uint64_t>& keys) {
+            for (size_t i = 0; i < keys.size(); ++i) {
+                readMostly->insert(keys[i], i);
+            }
+            return std::unique_ptr<ReadMostly::Reader>(new ReadMostly::Reader(readMostly->reader()));
+        }, [](const ReadMostly::Reader& reader, uint64_t key) {return reader.contains(key);});
+
+        // The snapshot is written from an UnorderedMap, only opening it counts as the build.
+        MappedMap<uint64_t, uint64_t>::save(*buildByIndex<UnorderedMap<uint64_t, uint64_t> >(work.keys), snapshot);
+        runEngine("MappedMap", work, [&snapshot](const std::vector<uint64_t>&) {
+            return std::unique_ptr<MappedMap<uint64_t, uint64_t> >(new MappedMap<uint64_t, uint64_t>(snapshot));
+        }, [](const MappedMap<uint64_t, uint64_t>& map, uint64_t key) {return map.contains(key);});
+        std::filesystem::remove(snapshot);
+
+        runFrozen<8>(work);
+        runFrozen<4096>(work);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Compares a loop of find with find_batch and contains_batch on tables larger than the LLC.
+// Usage: find_batch [size] [lookups]
+
+#include "UnMap.cpp"
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+int main(int argc, char** argv) {
+    size_t size = sizeArgument(argc, argv, 1, static_cast<size_t>(1) << 22);
+    size_t lookups = sizeArgument(argc, argv, 2, static_cast<size_t>(1) << 22);
+    const size_t batch = 256;
+
+    std::vector<uint64_t> keys = randomKeys(size, 1);
+    UnorderedMap<uint64_t, uint64_t> map;
+    map.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        map[keys[i]] = i;
+    }
+
+    uint64_t state = 2;
+    std::vector<uint64_t> probes(lookups);
+    for (size_t i = 0; i < lookups; ++i) {
+        probes[i] = keys[splitMix(state) % size];
+    }
+
+    reportHeader();
+
+    uint64_t sum = 0;
+    report(measure("find_loop", "UnorderedMap", size, lookups, [&]() {
+        for (size_t i = 0; i < lookups; ++i) {
+            sum += (*map.find(probes[i])).second;
+        }
+    }));
+    keep(sum);
+
+    std::vector<UnorderedMap<uint64_t, uint64_t>::iterator> found(batch);
+    report(measure("find_batch", "UnorderedMap", size, lookups, [&]() {
+        for (size_t i = 0; i < lookups; i += batch) {
+            size_t count = std::min(batch, lookups - i);
+            map.find_batch(probes.data() + i, count, found.data());
+            for (size_t j = 0; j < count; ++j) {
+                sum += (*found[j]).second;
+            }
+        }
+    }));
+    keep(sum);
+
+    bool present[batch];
+    size_t hits = 0;
+    report(measure("contains_batch", "UnorderedMap", size, lookups, [&]() {
+        for (size_t i = 0; i < lookups; i += batch) {
+            size_t count = std::min(batch, lookups - i);
+            map.contains_batch(probes.data() + i, count, present);
+            for (size_t j = 0; j < count; ++j) {
+                hits += present[j];
+            }
+        }
+    }));
+    keep(hits);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Compares a loop of find, find_batch and find_interleaved with several group sizes,
+// at the default load factor and with long chains. Needs C++20 coroutines.
+// Usage: find_interleaved [size] [lookups]
+
+#include "UnMap.cpp"
+#include "Bench.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using Map = UnorderedMap<uint64_t, uint64_t>;
+
+static void run(const std::string& container, double loadFactor, size_t size, size_t lookups) {
+    std::vector<uint64_t> keys = randomKeys(size, 1);
+    Map map;
+    map.max_load_factor(loadFactor);
+    map.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        map[keys[i]] = i;
+    }
+
+    uint64_t state = 2;
+    std::vector<uint64_t> probes(lookups);
+    for (size_t i = 0; i < lookups; ++i) {
+        probes[i] = keys[splitMix(state) % size];
+    }
+
+    const size_t batch = 256;
+    std::vector<Map::iterator> found(batch);
+    uint64_t sum = 0;
+
+    report(measure("find_loop", container, size, lookups, [&]() {
+        for (size_t i = 0; i < lookups; ++i) {
+            sum += (*map.find(probes[i])).second;
+        }
+    }));
+    keep(sum);
+
+    report(measure("find_batch", container, size, lookups, [&]() {
+        for (size_t i = 0; i < lookups; i += batch) {
+            size_t count = std::min(batch, lookups - i);
+            map.find_batch(probes.data() + i, count, found.data());
+            for (size_t j = 0; j < count; ++j) {
+                sum += (*found[j]).second;
+            }
+        }
+    }));
+    keep(sum);
+
+    for (size_t group : {2, 4, 8, 16, 32}) {
+        report(measure("find_interleaved_" + std::to_string(group), container, size, lookups, [&]() {
+            for (size_t i = 0; i < lookups; i += batch) {
+                size_t count = std::min(batch, lookups - i);
+                map.find_interleaved(probes.data() + i, count, found.data(), group);
+                for (size_t j = 0; j < count; ++j) {
+                    sum += (*found[j]).second;
+                }
+            }
+        }));
+        keep(sum);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t size = sizeArgument(argc, argv, 1, static_cast<size_t>(1) << 22);
+    size_t lookups = sizeArgument(argc, argv, 2, static_cast<size_t>(1) << 22);
+
+    reportHeader();
+    run("UnorderedMap", 0.5, size, lookups);
+    run("UnorderedMap_lf4", 4.0, size, lookups);
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Throughput of the hashes of FastHash.cpp against std::hash, by key length (size is the length
+// in bytes, ns_per_op is per hashed key), then the same hashes behind UnorderedMap.
+// Usage: hash_bench [total bytes hashed per length] [map size]
+
+#include "UnMap.cpp"
+#include "Bench.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+template<typename H>
+Result hashKeys(const std::string& name, const std::vector<unsigned char>& bytes, size_t length, size_t count, const H& hash) {
+    Result result = measure("hash", name, length, count, [&]() {
+        size_t sum = 0;
+        size_t span = bytes.size() - length;
+        for (size_t i = 0, offset = 0; i < count; ++i) {
+            sum += hash(std::string_view(reinterpret_cast<const char*>(bytes.data()) + offset, length));
+            offset = (offset + length + 1) % span;
+        }
+        keep(sum);
+    });
+    result.key = "bytes";
+    return result;
+}
+
+template<typename Map, typename K>
+void mapInsertFind(const std::string& name, const std::string& keyName, const std::vector<K>& keys) {
+    Map map;
+    Result insert = measure("insert", name, keys.size(), keys.size(), [&]() {
+        for (const K& key : keys) {
+            map[key] = 1;
+        }
+    });
+    insert.key = keyName;
+    report(insert);
+
+    Result find = measure("find_hit", name, keys.size(), keys.size(), [&]() {
+        size_t found = 0;
+        for (const K& key : keys) {
+            found += map.find(key) != map.end();
+        }
+        keep(found);
+    });
+    find.key = keyName;
+    report(find);
+}
+
+int main(int argc, char** argv) {
+    size_t totalBytes = sizeArgument(argc, argv, 1, static_cast<size_t>(1) << 28);
+    size_t size = sizeArgument(argc, argv, 2, static_cast<size_t>(1) << 20);
+
+    uint64_t state = 1;
+    std::vector<unsigned char> bytes(1 << 20);
+    for (unsigned char& byte : bytes) {
+        byte = static_cast<unsigned char>(splitMix(state));
+    }
+
+    reportHeader();
+
+    for (size_t length : {4, 8, 16, 32, 64, 128, 256, 1024, 4096, 65536}) {
+        size_t count = std::max<size_t>(totalBytes / length, 1 << 16);
+        count = std::min<size_t>(count, 1 << 24);
+        report(hashKeys("std::hash", bytes, length, count, std::hash<std::string_view>()));
+        report(hashKeys("FastHash", bytes, length, count, FastHash<std::string_view>()));
+        report(hashKeys("SeededHash", bytes, length, count, SeededHash<std::string_view>()));
+    }
+
+    std::vector<uint64_t> integers = randomKeys(size, 2);
+    // Multiples of 2^20: the identity std::hash leaves their low bits zero, the map's own mix has to fix that.
+    std::vector<uint64_t> strided(size);
+    for (size_t i = 0; i < size; ++i) {
+        strided[i] = static_cast<uint64_t>(i) << 20;
+    }
+    std::vector<std::string> strings(size);
+    for (size_t i = 0; i < size; ++i) {
+        strings[i] = "user:" + std::to_string(splitMix(state)) + ":session";
+    }
+
+    mapInsertFind<UnorderedMap<uint64_t, int> >("UnorderedMap std::hash", "uint64", integers);
+    mapInsertFind<UnorderedMap<uint64_t, int, FastHash<uint64_t> > >("UnorderedMap FastHash", "uint64", integers);
+    mapInsertFind<UnorderedMap<uint64_t, int> >("UnorderedMap std::hash", "uint64_strided", strided);
+    mapInsertFind<UnorderedMap<uint64_t, int, FastHash<uint64_t> > >("UnorderedMap FastHash", "uint64_strided", strided);
+    mapInsertFind<UnorderedMap<std::string, int> >("UnorderedMap std::hash", "string", strings);
+    mapInsertFind<UnorderedMap<std::string, int, FastHash<std::string> > >("UnorderedMap FastHash", "string", strings);
+    mapInsertFind<UnorderedMap<std::string, int, SeededHash<std::string> > >("UnorderedMap SeededHash", "string", strings);
+}
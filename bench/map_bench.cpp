@@ -0,0 +1,390 @@
+// Benchmark suite for UnorderedMap against FlatMap and std::unordered_map, the node maps each
+// with std::allocator and with FastAllocator: insert, reserve + insert, hit and miss lookups,
+// erase, iteration, copy, move and rehash over int, 64-bit and string keys.
+//
+// Usage: map_bench [--sizes 1000,100000] [--keys int,uint64,string]
+//                  [--distributions sequential,uniform,zipf] [--containers name,...]
+//                  [--benchmarks insert,lookup_hit,...]
+//
+// Keys are i (sequential) or a bijective mix of i (uniform, zipf), so they never repeat and
+// keys of indexes past the size are guaranteed misses. The distribution also decides which
+// keys lookups touch: in order, uniformly, or Zipf(0.99) skewed towards a few hot keys.
+// Every (container, key, distribution, size) case runs in its own process, so peak_rss_kb
+// is the peak of that case alone. Output is CSV, one line per result.
+
+#include "UnMap.cpp"
+#include "FlatMap.cpp"
+#include "Bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Zipf sampling over 1..n by rejection-inversion (Hormann, Derflinger), without tables.
+class ZipfGenerator {
+private:
+    double n_;
+    double exponent_;
+    double hIntegralX1_;
+    double hIntegralN_;
+    double threshold_;
+
+    static double helper1_(double x) {
+        return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+    static double helper2_(double x) {
+        return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+    double h_(double x) const {return std::exp(-exponent_ * std::log(x));}
+    double hIntegral_(double x) const {
+        double logX = std::log(x);
+        return helper2_((1 - exponent_) * logX) * logX;
+    }
+    double hIntegralInverse_(double x) const {
+        double t = std::max(-1.0, x * (1 - exponent_));
+        return std::exp(helper1_(t) * x);
+    }
+
+public:
+    ZipfGenerator(size_t n, double exponent) : n_(static_cast<double>(n)), exponent_(exponent) {
+        hIntegralX1_ = hIntegral_(1.5) - 1;
+        hIntegralN_ = hIntegral_(n_ + 0.5);
+        threshold_ = 2 - hIntegralInverse_(hIntegral_(2.5) - h_(2));
+    }
+
+    // Returns a rank in [0, n), rank 0 being the most frequent.
+    size_t next(uint64_t& state) const {
+        while (true) {
+            double uniform = static_cast<double>(splitMix(state) >> 11) * 0x1.0p-53;
+            double u = hIntegralN_ + uniform * (hIntegralX1_ - hIntegralN_);
+            double x = hIntegralInverse_(u);
+            double k = std::min(std::max(std::floor(x + 0.5), 1.0), n_);
+            if (k - x <= threshold_ || u >= hIntegral_(k + 0.5) - h_(k)) {
+                return static_cast<size_t>(k) - 1;
+            }
+        }
+    }
+};
+
+enum class Distribution {sequential, uniform, zipf};
+
+inline uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352DU;
+    x ^= x >> 15;
+    x *= 0x846CA68BU;
+    return x ^ (x >> 16);
+}
+
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+template<typename K>
+class KeyMaker;
+
+template<>
+class KeyMaker<int> {
+public:
+    static const char* name() {return "int";}
+    static int make(size_t i, Distribution d) {
+        uint32_t x = static_cast<uint32_t>(i);
+        return static_cast<int>(d == Distribution::sequential ? x : mix32(x));
+    }
+};
+
+template<>
+class KeyMaker<uint64_t> {
+public:
+    static const char* name() {return "uint64";}
+    static uint64_t make(size_t i, Distribution d) {
+        return d == Distribution::sequential ? i : mix64(i);
+    }
+};
+
+// 24 characters, long enough to defeat the small string optimization.
+template<>
+class KeyMaker<std::string> {
+public:
+    static const char* name() {return "string";}
+    static std::string make(size_t i, Distribution d) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "key:%016llx:end",
+                      static_cast<unsigned long long>(KeyMaker<uint64_t>::make(i, d)));
+        return std::string(buffer);
+    }
+};
+
+class Options {
+public:
+    std::vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    std::vector<std::string> keys = {"int", "uint64", "string"};
+    std::vector<std::string> distributions = {"sequential", "uniform", "zipf"};
+    std::vector<std::string> containers = {
+        "UnorderedMap", "UnorderedMap+FastAllocator", "FlatMap", "std::unordered_map", "std::unordered_map+FastAllocator"};
+    std::vector<std::string> benchmarks = {
+        "insert", "reserve", "lookup_hit", "lookup_miss", "erase", "iterate", "copy", "move", "rehash"};
+
+    bool wants(const std::string& benchmark) const {
+        return std::find(benchmarks.begin(), benchmarks.end(), benchmark) != benchmarks.end();
+    }
+};
+
+static std::vector<std::string> splitList(const char* text) {
+    std::vector<std::string> answer;
+    std::string current;
+    for (const char* c = text; *c; ++c) {
+        if (*c == ',') {
+            answer.push_back(current);
+            current.clear();
+        } else {
+            current += *c;
+        }
+    }
+    if (!current.empty()) {
+        answer.push_back(current);
+    }
+    return answer;
+}
+
+static Distribution parseDistribution(const std::string& name) {
+    if (name == "sequential") {
+        return Distribution::sequential;
+    }
+    return name == "zipf" ? Distribution::zipf : Distribution::uniform;
+}
+
+// Indexes in [0, size) in the order lookups of the given distribution touch them.
+static std::vector<size_t> accessOrder(size_t size, size_t count, Distribution distribution, uint64_t seed) {
+    std::vector<size_t> order(count);
+    if (distribution == Distribution::sequential) {
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = i % size;
+        }
+    } else if (distribution == Distribution::uniform) {
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = splitMix(seed) % size;
+        }
+    } else {
+        ZipfGenerator zipf(size, 0.99);
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = zipf.next(seed);
+        }
+    }
+    return order;
+}
+
+template<typename Map, typename K>
+void runCase(const Options& options, const std::string& container, Distribution distribution,
+             const std::string& distributionName, size_t size) {
+    std::vector<K> keys(size);
+    std::vector<K> misses(size);
+    for (size_t i = 0; i < size; ++i) {
+        keys[i] = KeyMaker<K>::make(i, distribution);
+        misses[i] = KeyMaker<K>::make(i + size, distribution);
+    }
+    size_t lookups = std::min(std::max(size, static_cast<size_t>(1) << 20), static_cast<size_t>(1) << 24);
+    std::vector<size_t> order = accessOrder(size, lookups, distribution, 7);
+
+    auto emit = [&](Result result) {
+        result.key = KeyMaker<K>::name();
+        result.distribution = distributionName;
+        report(result);
+    };
+
+    if (options.wants("insert")) {
+        Map map;
+        emit(measure("insert", container, size, size, [&]() {
+            for (size_t i = 0; i < size; ++i) {
+                map[keys[i]] = i;
+            }
+        }));
+    }
+
+    if (options.wants("reserve")) {
+        Map map;
+        emit(measure("reserve", container, size, size, [&]() {
+            map.reserve(size);
+            for (size_t i = 0; i < size; ++i) {
+                map[keys[i]] = i;
+            }
+        }));
+    }
+
+    Map map;
+    for (size_t i = 0; i < size; ++i) {
+        map[keys[i]] = i;
+    }
+    uint64_t sum = 0;
+
+    if (options.wants("lookup_hit")) {
+        emit(measure("lookup_hit", container, size, lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i) {
+                sum += (*map.find(keys[order[i]])).second;
+            }
+        }));
+    }
+
+    if (options.wants("lookup_miss")) {
+        emit(measure("lookup_miss", container, size, lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i) {
+                sum += map.find(misses[order[i]]) == map.end();
+            }
+        }));
+    }
+
+    if (options.wants("iterate")) {
+        size_t rounds = std::max(static_cast<size_t>(1), lookups / std::max(size, static_cast<size_t>(1)));
+        emit(measure("iterate", container, size, rounds * size, [&]() {
+            for (size_t round = 0; round < rounds; ++round) {
+                for (auto it = map.begin(); it != map.end(); ++it) {
+                    sum += (*it).second;
+                }
+            }
+        }));
+    }
+
+    if (options.wants("copy")) {
+        emit(measure("copy", container, size, size, [&]() {
+            Map copy(map);
+            sum += copy.size();
+        }));
+    }
+
+    if (options.wants("move")) {
+        const size_t rounds = 1000;
+        emit(measure("move", container, size, rounds, [&]() {
+            for (size_t round = 0; round < rounds; ++round) {
+                Map moved(std::move(map));
+                map = std::move(moved);
+            }
+        }));
+    }
+
+    if (options.wants("rehash")) {
+        emit(measure("rehash", container, size, size, [&]() {
+            map.reserve(4 * size);
+        }));
+    }
+
+    if (options.wants("erase")) {
+        std::vector<size_t> victims(size);
+        for (size_t i = 0; i < size; ++i) {
+            victims[i] = i;
+        }
+        if (distribution != Distribution::sequential) {
+            uint64_t state = 11;
+            for (size_t i = size; i > 1; --i) {
+                std::swap(victims[i - 1], victims[splitMix(state) % i]);
+            }
+        }
+        emit(measure("erase", container, size, size, [&]() {
+            for (size_t i = 0; i < size; ++i) {
+                map.erase(keys[victims[i]]);
+            }
+        }));
+    }
+
+    keep(sum);
+}
+
+template<typename K>
+void runContainer(const Options& options, const std::string& container, Distribution distribution,
+                  const std::string& distributionName, size_t size) {
+    using Value = uint64_t;
+    using Pair = std::pair<const K, Value>;
+    if (container == "UnorderedMap") {
+        runCase<UnorderedMap<K, Value>, K>(options, container, distribution, distributionName, size);
+    } else if (container == "UnorderedMap+FastAllocator") {
+        runCase<UnorderedMap<K, Value, std::hash<K>, std::equal_to<K>, FastAllocator<Pair> >, K>(
+            options, container, distribution, distributionName, size);
+    } else if (container == "FlatMap") {
+        runCase<FlatMap<K, Value>, K>(options, container, distribution, distributionName, size);
+    } else if (container == "std::unordered_map") {
+        runCase<std::unordered_map<K, Value>, K>(options, container, distribution, distributionName, size);
+    } else if (container == "std::unordered_map+FastAllocator") {
+        runCase<std::unordered_map<K, Value, std::hash<K>, std::equal_to<K>, FastAllocator<Pair> >, K>(
+            options, container, distribution, distributionName, size);
+    } else {
+        std::fprintf(stderr, "unknown container %s\n", container.c_str());
+    }
+}
+
+// Runs f in a child process where possible, so each case starts from a fresh heap and RSS.
+template<typename F>
+void isolated(F&& f) {
+#if defined(__unix__) || defined(__APPLE__)
+    std::fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        f();
+        std::fflush(stdout);
+        _exit(0);
+    }
+    if (child > 0) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        return;
+    }
+#endif
+    f();
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::vector<std::string> values = splitList(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--sizes")) {
+            options.sizes.clear();
+            for (const std::string& value : values) {
+                options.sizes.push_back(static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10)));
+            }
+        } else if (!std::strcmp(argv[i], "--keys")) {
+            options.keys = values;
+        } else if (!std::strcmp(argv[i], "--distributions")) {
+            options.distributions = values;
+        } else if (!std::strcmp(argv[i], "--containers")) {
+            options.containers = values;
+        } else if (!std::strcmp(argv[i], "--benchmarks")) {
+            options.benchmarks = values;
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    reportHeader();
+    for (size_t size : options.sizes) {
+        for (const std::string& key : options.keys) {
+            for (const std::string& distributionName : options.distributions) {
+                Distribution distribution = parseDistribution(distributionName);
+                for (const std::string& container : options.containers) {
+                    isolated([&]() {
+                        if (key == "int") {
+                            runContainer<int>(options, container, distribution, distributionName, size);
+                        } else if (key == "string") {
+                            runContainer<std::string>(options, container, distribution, distributionName, size);
+                        } else {
+                            runContainer<uint64_t>(options, container, distribution, distributionName, size);
+                        }
+                    });
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Loads a map of string keys and values from a MapStream image in memory, compared with
+// reading the same elements into a vector (the bandwidth bound) and with inserting them one by one.
+// Usage: map_stream [size]
+
+#include "MapStream.cpp"
+#include "Bench.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    size_t size = sizeArgument(argc, argv, 1, static_cast<size_t>(1) << 20);
+
+    uint64_t state = 1;
+    UnorderedMap<std::string, std::string> source;
+    for (size_t i = 0; i < size; ++i) {
+        std::string key = "key:" + std::to_string(splitMix(state));
+        source[key] = std::string(8 + splitMix(state) % 32, 'v');
+    }
+    std::stringstream image;
+    MapStream<std::string, std::string>::write(image, source);
+    std::string bytes = image.str();
+
+    auto stringKeys = [](Result result) {
+        result.key = "string";
+        return result;
+    };
+
+    reportHeader();
+
+    report(stringKeys(measure("stream_write", "UnorderedMap", size, size, [&]() {
+        std::ostringstream out;
+        MapStream<std::string, std::string>::write(out, source);
+        keep(out.tellp());
+    })));
+
+    report(stringKeys(measure("decode_only", "vector", size, size, [&]() {
+        std::istringstream in(bytes);
+        StreamReader reader(in);
+        std::vector<std::pair<std::string, std::string> > elements;
+        elements.reserve(size);
+        char header[24];
+        reader.read(header, sizeof(header));
+        for (size_t i = 0; i < size; ++i) {
+            RecordReader record = reader.record();
+            auto key = Codec<std::string>::decode(record);
+            auto value = Codec<std::string>::decode(record);
+            elements.emplace_back(std::piecewise_construct, key, value);
+        }
+        keep(elements.size());
+    })));
+
+    report(stringKeys(measure("insert_loop", "UnorderedMap", size, size, [&]() {
+        UnorderedMap<std::string, std::string> map;
+        for (auto it = source.cbegin(); it != source.cend(); ++it) {
+            map.insert(*it);
+        }
+        keep(map.size());
+    })));
+
+    report(stringKeys(measure("stream_read", "UnorderedMap", size, size, [&]() {
+        std::istringstream in(bytes);
+        UnorderedMap<std::string, std::string> map;
+        MapStream<std::string, std::string>::read(in, map);
+        keep(map.size());
+    })));
+
+    return 0;
+}
@@ -1,100 +1,332 @@
+#pragma once
+
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Block sizes and release policy of FixedAllocator. New allocators copy defaults().
+class FixedAllocatorOptions {
+public:
+    size_t firstBlock = 64;
+    size_t growthFactor = 2;
+    size_t maxBlock = 512;
+    // Fully free blocks above this number are released as soon as they become free.
+    size_t keepFreeBlocks = static_cast<size_t>(-1);
+    // Blocks of at least 2 MiB are mapped separately and advised to use huge pages.
+    bool largePages = false;
+
+    static FixedAllocatorOptions& defaults() {
+        static FixedAllocatorOptions options;
+        return options;
+    }
+
+    // The same options with every block size and the growth factor raised to at least 1,
+    // so a block always holds a chunk.
+    FixedAllocatorOptions clamped() const {
+        FixedAllocatorOptions answer = *this;
+        answer.firstBlock = std::max<size_t>(answer.firstBlock, 1);
+        answer.growthFactor = std::max<size_t>(answer.growthFactor, 1);
+        answer.maxBlock = std::max<size_t>(answer.maxBlock, 1);
+        return answer;
+    }
+};
 
 template <size_t chunkSize>
 class FixedAllocator {
 private:
 
-    static const size_t sizeBound_ = 512;
+    static const size_t largePageSize_ = static_cast<size_t>(2) << 20;
 
+    class Block_;
+
+    // While the chunk is free it points to the next free chunk of its block,
+    // while it is allocated it points to the block itself.
     class Chunk_ {
     public:
         char memory[chunkSize];
-        Chunk_* nextChunk;
+        union {
+            Chunk_* nextChunk;
+            Block_* owner;
+        };
         Chunk_() : nextChunk(nullptr) {}
         ~Chunk_() {}
     };
 
-    Chunk_* firstFree_ = nullptr;
+    class Block_ {
+    public:
+        Chunk_* chunks = nullptr;
+        size_t count = 0;
+        size_t bytes = 0;
+        size_t used = 0;
+        Chunk_* firstFree = nullptr;
+        Block_* prevPartial = nullptr;
+        Block_* nextPartial = nullptr;
+        bool mapped = false;
+    };
+
+    Block_* firstPartial_ = nullptr;
 
-    std :: vector<Chunk_*> pool_;
+    std :: vector<Block_*> pool_;
     size_t size_;
+    size_t freeBlocks_ = 0;
+    size_t used_ = 0;
+    FixedAllocatorOptions options_;
 
     void getMemory_();
+    void releaseBlock_(Block_* block);
+    void linkPartial_(Block_* block);
+    void unlinkPartial_(Block_* block);
 
 public:
 
     ~FixedAllocator();
     FixedAllocator();
     FixedAllocator(const FixedAllocator<chunkSize>& A);
+    FixedAllocator(FixedAllocator<chunkSize>&& A);
+    FixedAllocator& operator=(const FixedAllocator<chunkSize>& A) = delete;
+    FixedAllocator& operator=(FixedAllocator<chunkSize>&& A);
 
     void* allocate();
 
     void deallocate(void* release);
 
+    size_t trim();
+
+    void setOptions(const FixedAllocatorOptions& options);
+
+    size_t capacity() const;
+
+    size_t size() const {return used_;}
+
+    size_t reservedBytes() const;
+
+    const FixedAllocatorOptions& options() const {return options_;}
+
     static FixedAllocator& use();
 };
 
 
 template<size_t chunkSize>
 void FixedAllocator<chunkSize>::getMemory_() {
-    firstFree_ = new Chunk_[size_];
+    Block_* block = new Block_();
+    block->bytes = size_ * sizeof(Chunk_);
+
+#ifdef __linux__
+    if (options_.largePages && block->bytes >= largePageSize_) {
+        size_t bytes = (block->bytes + largePageSize_ - 1) / largePageSize_ * largePageSize_;
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            madvise(memory, bytes, MADV_HUGEPAGE);
+            block->chunks = static_cast<Chunk_*>(memory);
+            block->bytes = bytes;
+            block->mapped = true;
+        }
+    }
+#endif
 
-    for (size_t i = 0; i + 1 < size_; ++i) {
-        firstFree_[i].nextChunk = &firstFree_[i + 1];
+    if (!block->mapped) {
+        block->chunks = static_cast<Chunk_*>(::operator new(block->bytes));
     }
+    block->count = block->bytes / sizeof(Chunk_);
 
-    firstFree_[size_ - 1].nextChunk = nullptr;
+    for (size_t i = 0; i < block->count; ++i) {
+        new (&block->chunks[i]) Chunk_();
+        block->chunks[i].nextChunk = i + 1 < block->count ? &block->chunks[i + 1] : nullptr;
+    }
+    block->firstFree = block->chunks;
 
-    pool_.push_back(firstFree_);
+    pool_.push_back(block);
+    linkPartial_(block);
+    ++freeBlocks_;
 
-    if (size_ < sizeBound_) {
-        size_ <<= 1;
+    if (size_ < options_.maxBlock) {
+        size_ = std::min(size_ * options_.growthFactor, options_.maxBlock);
+    }
+}
+
+template<size_t chunkSize>
+void FixedAllocator<chunkSize>::releaseBlock_(Block_* block) {
+    unlinkPartial_(block);
+    --freeBlocks_;
+
+    for (size_t i = 0; i < pool_.size(); ++i) {
+        if (pool_[i] == block) {
+            pool_[i] = pool_.back();
+            pool_.pop_back();
+            break;
+        }
+    }
+
+#ifdef __linux__
+    if (block->mapped) {
+        munmap(block->chunks, block->bytes);
+    }
+#endif
+    if (!block->mapped) {
+        ::operator delete(block->chunks);
+    }
+    delete block;
+}
+
+template<size_t chunkSize>
+void FixedAllocator<chunkSize>::linkPartial_(Block_* block) {
+    block->prevPartial = nullptr;
+    block->nextPartial = firstPartial_;
+    if (firstPartial_) {
+        firstPartial_->prevPartial = block;
     }
+    firstPartial_ = block;
+}
+
+template<size_t chunkSize>
+void FixedAllocator<chunkSize>::unlinkPartial_(Block_* block) {
+    if (block->prevPartial) {
+        block->prevPartial->nextPartial = block->nextPartial;
+    } else {
+        firstPartial_ = block->nextPartial;
+    }
+    if (block->nextPartial) {
+        block->nextPartial->prevPartial = block->prevPartial;
+    }
+    block->prevPartial = nullptr;
+    block->nextPartial = nullptr;
 }
 
 template<size_t chunkSize>
 FixedAllocator<chunkSize>::~FixedAllocator() {
     while (!pool_.empty()) {
-        Chunk_* ptr = pool_.back();
+        Block_* block = pool_.back();
         pool_.pop_back();
-        delete[] ptr;
+#ifdef __linux__
+        if (block->mapped) {
+            munmap(block->chunks, block->bytes);
+        }
+#endif
+        if (!block->mapped) {
+            ::operator delete(block->chunks);
+        }
+        delete block;
     }
 }
 
 template<size_t chunkSize>
-FixedAllocator<chunkSize>::FixedAllocator() {
-    size_ = 64;
+FixedAllocator<chunkSize>::FixedAllocator() : options_(FixedAllocatorOptions::defaults().clamped()) {
+    size_ = options_.firstBlock;
 }
 
+// Blocks are never shared: the copy starts empty with the same options.
 template<size_t chunkSize>
-FixedAllocator<chunkSize>::FixedAllocator(const FixedAllocator<chunkSize>& A) {
-    for (size_t i = 0; i < A.pool_.size(); ++i) {
-        getMemory_();
-    }
+FixedAllocator<chunkSize>::FixedAllocator(const FixedAllocator<chunkSize>& A) : options_(A.options_) {
+    size_ = options_.firstBlock;
+}
 
-    pool_ = A.pool_;
+// Moving hands the blocks over, so chunks allocated before the move are freed by the new owner.
+template<size_t chunkSize>
+FixedAllocator<chunkSize>::FixedAllocator(FixedAllocator<chunkSize>&& A) : options_(A.options_) {
+    size_ = options_.firstBlock;
+    *this = std::move(A);
+}
+
+template<size_t chunkSize>
+FixedAllocator<chunkSize>& FixedAllocator<chunkSize>::operator=(FixedAllocator<chunkSize>&& A) {
+    std::swap(firstPartial_, A.firstPartial_);
+    std::swap(pool_, A.pool_);
+    std::swap(size_, A.size_);
+    std::swap(freeBlocks_, A.freeBlocks_);
+    std::swap(used_, A.used_);
+    std::swap(options_, A.options_);
+    return *this;
 }
 
 template<size_t chunkSize>
 void* FixedAllocator<chunkSize>::allocate() {
-    if (!firstFree_) {
+    if (!firstPartial_) {
         getMemory_();
     }
 
-    Chunk_* Return = firstFree_;
-    firstFree_ = firstFree_ -> nextChunk;
+    Block_* block = firstPartial_;
+    Chunk_* Return = block->firstFree;
+    block->firstFree = Return -> nextChunk;
+    if (!block->firstFree) {
+        unlinkPartial_(block);
+    }
+    if (!block->used++) {
+        --freeBlocks_;
+    }
+    ++used_;
+
+    Return -> owner = block;
     return static_cast<void*>(Return);
 }
 
 template<size_t chunkSize>
 void FixedAllocator<chunkSize>::deallocate(void* release) {
     Chunk_* ChunkRelease = static_cast<Chunk_*>(release);
-    ChunkRelease -> nextChunk = firstFree_;
-    firstFree_ = ChunkRelease;
+    Block_* block = ChunkRelease -> owner;
+    if (!block->firstFree) {
+        linkPartial_(block);
+    }
+    ChunkRelease -> nextChunk = block->firstFree;
+    block->firstFree = ChunkRelease;
+    --used_;
+
+    if (!--block->used) {
+        ++freeBlocks_;
+        if (freeBlocks_ > options_.keepFreeBlocks) {
+            releaseBlock_(block);
+        }
+    }
+}
+
+// Releases every block none of whose chunks is allocated. Returns the number of bytes released.
+template<size_t chunkSize>
+size_t FixedAllocator<chunkSize>::trim() {
+    size_t released = 0;
+    for (size_t i = pool_.size(); i > 0; --i) {
+        Block_* block = pool_[i - 1];
+        if (!block->used) {
+            released += block->bytes;
+            releaseBlock_(block);
+        }
+    }
+    return released;
+}
+
+template<size_t chunkSize>
+void FixedAllocator<chunkSize>::setOptions(const FixedAllocatorOptions& options) {
+    options_ = options.clamped();
+    if (pool_.empty() || size_ < options_.firstBlock) {
+        size_ = options_.firstBlock;
+    }
+    if (size_ > options_.maxBlock) {
+        size_ = options_.maxBlock;
+    }
+}
+
+template<size_t chunkSize>
+size_t FixedAllocator<chunkSize>::capacity() const {
+    size_t answer = 0;
+    for (size_t i = 0; i < pool_.size(); ++i) {
+        answer += pool_[i]->count;
+    }
+    return answer;
 }
 
+template<size_t chunkSize>
+size_t FixedAllocator<chunkSize>::reservedBytes() const {
+    size_t answer = 0;
+    for (size_t i = 0; i < pool_.size(); ++i) {
+        answer += pool_[i]->bytes;
+    }
+    return answer;
+}
 
 template<size_t chunkSize>
 FixedAllocator<chunkSize>& FixedAllocator<chunkSize>::use() {
@@ -102,6 +334,12 @@ FixedAllocator<chunkSize>& FixedAllocator<chunkSize>::use() {
     return forUse;
 }
 
+// Bytes a general purpose malloc really takes for one block of the given size,
+// estimated after glibc: a size word in front, 16-byte granularity, 32 bytes at least.
+inline size_t mallocFootprint(size_t bytes) {
+    return std::max<size_t>(32, (bytes + sizeof(size_t) + 15) / 16 * 16);
+}
+
 template<typename T>
 class FastAllocator {
 private:
@@ -111,6 +349,9 @@ private:
 public:
     using value_type = T;
     using pointer = T*;
+    // The pool travels with the container, so moved or swapped containers keep their nodes valid.
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
     template<typename U>
     class rebind {
     public:
@@ -119,17 +360,38 @@ public:
 
     FastAllocator() {}
     FastAllocator(const FastAllocator& A) : alloc_(A.alloc_) {}
+    FastAllocator(FastAllocator&& A) : alloc_(std::move(A.alloc_)) {}
+    template<typename U>
+    FastAllocator(const FastAllocator<U>& A) {alloc_.setOptions(A.options());}
+    FastAllocator& operator=(FastAllocator&& A) {alloc_ = std::move(A.alloc_); return *this;}
     ~FastAllocator() {}
 
     pointer allocate(size_t n);
 
     void deallocate(pointer release, size_t n);
 
-    void construct(pointer p, const T& make) const;
+    template<typename U, typename... Args>
+    void construct(U* p, Args&& ...args) const;
+
+    template<typename U>
+    void destroy(U* p) const;
+
+    size_t trim() {return alloc_.trim();}
+
+    void setOptions(const FixedAllocatorOptions& options) {alloc_.setOptions(options);}
 
-    void destroy(pointer p) const;
+    const FixedAllocatorOptions& options() const {return alloc_.options();}
+
+    // Bytes held for live single objects, which are pooled unless T is too large.
+    size_t reservedBytes(size_t live) const {
+        return sizeof(T) > memorySize_ ? live * mallocFootprint(sizeof(T)) : alloc_.reservedBytes();
+    }
 
     static FastAllocator<T> select_on_container_copy_construction(const FastAllocator<T>& alloc);
+
+    // Every FastAllocator owns its pool, so memory is only interchangeable within one object.
+    bool operator==(const FastAllocator& other) const {return this == &other;}
+    bool operator!=(const FastAllocator& other) const {return this != &other;}
 };
 
 template<typename T>
@@ -151,13 +413,15 @@ void FastAllocator<T>::deallocate(typename FastAllocator<T>::pointer release, si
 }
 
 template<typename T>
-void FastAllocator<T>::construct(typename FastAllocator<T>::pointer p, const T& make) const {
-    new (p) T(make);
+template<typename U, typename... Args>
+void FastAllocator<T>::construct(U* p, Args&& ...args) const {
+    new (p) U(std::forward<Args>(args)...);
 }
 
 template<typename T>
-void FastAllocator<T>::destroy(typename FastAllocator<T> :: pointer p) const {
-    p->~T();
+template<typename U>
+void FastAllocator<T>::destroy(U* p) const {
+    p->~U();
 }
 
 template<typename T>
@@ -166,6 +430,252 @@ FastAllocator<T> FastAllocator<T>::select_on_container_copy_construction(const F
     return answer;
 }
 
+// Thread-aware FixedAllocator. Every thread keeps its own free list and only touches the
+// shared pool, under a lock, to take or give back a whole batch of chunks.
+// Chunks are interchangeable, so a chunk allocated on one thread may be freed on any other:
+// it simply goes to the freeing thread's list, without a lock.
+template <size_t chunkSize>
+class ConcurrentFixedAllocator {
+private:
+
+    static const size_t batchSize_ = 32;
+    static const size_t sizeBound_ = 512;
+
+    // Only a free chunk needs its link, so the link shares the chunk's memory.
+    union Chunk_ {
+        char memory[chunkSize];
+        Chunk_* nextChunk;
+        Chunk_() : nextChunk(nullptr) {}
+    };
+
+    class Batch_ {
+    public:
+        Chunk_* first;
+        size_t count;
+    };
+
+    class ThreadCache_ {
+    public:
+        Chunk_* firstFree = nullptr;
+        size_t count = 0;
+        ~ThreadCache_();
+    };
+
+    std::mutex lock_;
+    // Keeps every block reachable, so leak checkers do not report the pool.
+    std::vector<Chunk_*> pool_;
+    std::vector<Batch_> batches_;
+    size_t size_ = batchSize_ * 2;
+
+    void getMemory_();
+    Batch_ fetchBatch_();
+    void returnBatch_(Batch_ batch);
+    static ThreadCache_& cache_();
+    ConcurrentFixedAllocator() {}
+
+public:
+
+    // The only instance is use()'s and it is never destroyed.
+    ~ConcurrentFixedAllocator() = delete;
+    ConcurrentFixedAllocator(const ConcurrentFixedAllocator<chunkSize>& A) = delete;
+
+    void* allocate();
+
+    void deallocate(void* release);
+
+    static ConcurrentFixedAllocator& use();
+};
+
+template<size_t chunkSize>
+void ConcurrentFixedAllocator<chunkSize>::getMemory_() {
+    Chunk_* block = new Chunk_[size_];
+    pool_.push_back(block);
+
+    for (size_t i = 0; i < size_; i += batchSize_) {
+        for (size_t j = i; j + 1 < i + batchSize_; ++j) {
+            block[j].nextChunk = &block[j + 1];
+        }
+        block[i + batchSize_ - 1].nextChunk = nullptr;
+        batches_.push_back({&block[i], batchSize_});
+    }
+
+    if (size_ < sizeBound_ * batchSize_) {
+        size_ <<= 1;
+    }
+}
+
+template<size_t chunkSize>
+typename ConcurrentFixedAllocator<chunkSize>::Batch_ ConcurrentFixedAllocator<chunkSize>::fetchBatch_() {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (batches_.empty()) {
+        getMemory_();
+    }
+    Batch_ batch = batches_.back();
+    batches_.pop_back();
+    return batch;
+}
+
+template<size_t chunkSize>
+void ConcurrentFixedAllocator<chunkSize>::returnBatch_(Batch_ batch) {
+    std::lock_guard<std::mutex> guard(lock_);
+    batches_.push_back(batch);
+}
+
+template<size_t chunkSize>
+ConcurrentFixedAllocator<chunkSize>::ThreadCache_::~ThreadCache_() {
+    if (firstFree) {
+        use().returnBatch_({firstFree, count});
+    }
+}
+
+template<size_t chunkSize>
+typename ConcurrentFixedAllocator<chunkSize>::ThreadCache_& ConcurrentFixedAllocator<chunkSize>::cache_() {
+    static thread_local ThreadCache_ cache;
+    return cache;
+}
+
+template<size_t chunkSize>
+void* ConcurrentFixedAllocator<chunkSize>::allocate() {
+    ThreadCache_& cache = cache_();
+    if (!cache.firstFree) {
+        Batch_ batch = fetchBatch_();
+        cache.firstFree = batch.first;
+        cache.count = batch.count;
+    }
+
+    Chunk_* Return = cache.firstFree;
+    cache.firstFree = cache.firstFree -> nextChunk;
+    --cache.count;
+    return static_cast<void*>(Return);
+}
+
+// Keeps at most two batches per thread; the older one goes back to the shared pool.
+template<size_t chunkSize>
+void ConcurrentFixedAllocator<chunkSize>::deallocate(void* release) {
+    ThreadCache_& cache = cache_();
+    Chunk_* ChunkRelease = static_cast<Chunk_*>(release);
+    ChunkRelease -> nextChunk = cache.firstFree;
+    cache.firstFree = ChunkRelease;
+    ++cache.count;
+
+    if (cache.count >= 2 * batchSize_) {
+        Chunk_* last = cache.firstFree;
+        for (size_t i = 1; i < batchSize_; ++i) {
+            last = last -> nextChunk;
+        }
+        Batch_ batch = {last -> nextChunk, cache.count - batchSize_};
+        last -> nextChunk = nullptr;
+        cache.count = batchSize_;
+        returnBatch_(batch);
+    }
+}
+
+// Never destroyed: thread caches of threads that outlive static destruction still return to it.
+template<size_t chunkSize>
+ConcurrentFixedAllocator<chunkSize>& ConcurrentFixedAllocator<chunkSize>::use() {
+    static ConcurrentFixedAllocator<chunkSize>* forUse = new ConcurrentFixedAllocator<chunkSize>();
+    return *forUse;
+}
+
+// FastAllocator over the process-wide ConcurrentFixedAllocator. It has no state of its own,
+// so any two instances are equal and one may free what the other allocated, on any thread.
+template<typename T>
+class ConcurrentFastAllocator {
+private:
+    static const size_t memorySize_ = 256;
+
+public:
+    using value_type = T;
+    using pointer = T*;
+    using is_always_equal = std::true_type;
+    template<typename U>
+    class rebind {
+    public:
+        using other = ConcurrentFastAllocator<U>;
+    };
+
+    ConcurrentFastAllocator() {}
+    template<typename U>
+    ConcurrentFastAllocator(const ConcurrentFastAllocator<U>&) {}
+
+    pointer allocate(size_t n);
+
+    void deallocate(pointer release, size_t n);
+
+    // Bytes held for live single objects, which are pooled without a header unless T is too large.
+    size_t reservedBytes(size_t live) const {
+        return sizeof(T) > memorySize_ ? live * mallocFootprint(sizeof(T)) : live * std::max(sizeof(T), sizeof(void*));
+    }
+
+    template<typename U>
+    bool operator==(const ConcurrentFastAllocator<U>&) const {return true;}
+    template<typename U>
+    bool operator!=(const ConcurrentFastAllocator<U>&) const {return false;}
+};
+
+template<typename T>
+typename ConcurrentFastAllocator<T>::pointer ConcurrentFastAllocator<T>::allocate(size_t n) {
+    if (n > 1 || sizeof(T) > memorySize_) {
+        return std::allocator<T>().allocate(n);
+    } else {
+        return static_cast<pointer>(ConcurrentFixedAllocator<sizeof(T)>::use().allocate());
+    }
+}
+
+template<typename T>
+void ConcurrentFastAllocator<T>::deallocate(typename ConcurrentFastAllocator<T>::pointer release, size_t n) {
+    if (n > 1 || sizeof(T) > memorySize_) {
+        std::allocator<T>().deallocate(release, n);
+    } else {
+        ConcurrentFixedAllocator<sizeof(T)>::use().deallocate(static_cast<void*>(release));
+    }
+}
+
+// The allocator node containers use for Allocator. Nodes of the default one are pooled, so they
+// take their own size and not a malloc block; the pool is shared, so nodes still move between
+// containers without copies.
+template<typename Allocator>
+class NodeAllocatorFor {
+public:
+    using type = Allocator;
+};
+
+// The pool's blocks are only aligned as operator new aligns them.
+template<typename T>
+class NodeAllocatorFor<std::allocator<T> > {
+public:
+    using type = typename std::conditional<alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, ConcurrentFastAllocator<T>, std::allocator<T> >::type;
+};
+
+// Calls trim() of allocators that have one, like FastAllocator.
+template<typename Allocator, typename = void>
+class AllocatorTrim {
+public:
+    static size_t trim(Allocator&) {return 0;}
+};
+
+template<typename Allocator>
+class AllocatorTrim<Allocator, decltype(void(std::declval<Allocator&>().trim()))> {
+public:
+    static size_t trim(Allocator& alloc) {return alloc.trim();}
+};
+
+// Bytes an allocator holds for live single objects of type T: what it reports through
+// reservedBytes(live) if it can, a malloc estimate otherwise.
+template<typename Allocator, typename = void>
+class AllocatorFootprint {
+public:
+    static size_t reservedBytes(const Allocator&, size_t live) {
+        return live * mallocFootprint(sizeof(typename Allocator::value_type));
+    }
+};
+
+template<typename Allocator>
+class AllocatorFootprint<Allocator, decltype(void(std::declval<const Allocator&>().reservedBytes(size_t())))> {
+public:
+    static size_t reservedBytes(const Allocator& alloc, size_t live) {return alloc.reservedBytes(live);}
+};
+
 template<typename T, typename Allocator = std::allocator<T> >
 class List
 {
@@ -236,7 +746,7 @@ public:
         iterator operator++(int);
         iterator(Node* other) : currentNode(other) {}
         iterator() : currentNode(nullptr) {}
-        iterator(const const_iterator& other) : currentNode(other.currentNode) {}
+        iterator(const const_iterator& other) : currentNode(const_cast<Node*>(other.currentNode)) {}
         iterator& operator=(iterator other) {currentNode = other.currentNode; return *this;}
         T* operator->() {return &(currentNode->data_);}
         bool operator==(const iterator& other);
@@ -256,6 +766,7 @@ public:
     const_iterator cbegin() const;
     const_iterator cend() const;
     List<T, Allocator>& operator=(const List<T, Allocator>& A);
+    List<T, Allocator>& operator=(List<T, Allocator>&& A);
     size_t size() const;
     void push_back(const T& value);
     void push_front(const T& value);
@@ -284,11 +795,9 @@ public:
 };
 
 template<typename T, typename Allocator>
-List<T, Allocator>::List(List<T, Allocator>&& A) {
+List<T, Allocator>::List(List<T, Allocator>&& A) : alloc_(std::move(A.alloc_)), nodeAlloc_(std::move(A.nodeAlloc_)) {
     head_ = A.head_;
     tail_ = A.tail_;
-    nodeAlloc_ = std::move(A.nodeAlloc_);
-    alloc_ = std::move(A.alloc_);
     notBuild = A.notBuild;
     size_ = A.size_;
     A.head_ = nullptr;
@@ -591,14 +1100,30 @@ List<T, Allocator>::List(const List<T, Allocator>& A) : List(A.alloc_) {
 template<typename T, typename Allocator>
 List<T, Allocator>::~List() {
     clear();
+    if (!notBuild) {
+        removeNode(head_);
+        removeNode(tail_);
+    }
 }
 
 template<typename T, typename Allocator>
 List<T, Allocator>& List<T, Allocator>::operator=(const List<T, Allocator>& A) {
-    clear();
-    alloc_ = std::allocator_traits<Allocator>::select_on_container_copy_construction(A.alloc_);
-    nodeAlloc_ = std::allocator_traits<additionalAllocator>::select_on_container_copy_construction(A.nodeAlloc_);
-    concatenate(A);
+    if (this != &A) {
+        clear();
+        concatenate(A);
+    }
+    return (*this);
+}
+
+// The lists trade everything, allocators included, so each node is still freed by its own.
+template<typename T, typename Allocator>
+List<T, Allocator>& List<T, Allocator>::operator=(List<T, Allocator>&& A) {
+    std::swap(head_, A.head_);
+    std::swap(tail_, A.tail_);
+    std::swap(alloc_, A.alloc_);
+    std::swap(nodeAlloc_, A.nodeAlloc_);
+    std::swap(size_, A.size_);
+    std::swap(notBuild, A.notBuild);
     return (*this);
 }
 
@@ -615,3 +1140,151 @@ template<typename T, typename Allocator>
 typename List<T, Allocator>::Node* List<T, Allocator>::next(Node* ptr) {
     return ptr->next_;
 }
+
+// The hash a ForwardList node keeps beside its element, if it keeps one.
+template<bool cached>
+class NodeHash {
+public:
+    size_t hash_ = 0;
+};
+
+template<>
+class NodeHash<false> {};
+
+// Singly linked list of nodes that hold one element each, and the hash of it when cacheHash is set.
+// Instead of sentinels it has before_, a bare link in the list object itself, and the list ends
+// with a null next_. It only owns the nodes: the container links them through Link::next_.
+template<typename T, typename Allocator = std::allocator<T>, bool cacheHash = true>
+class ForwardList {
+public:
+    class Node;
+
+    class Link {
+    public:
+        Node* next_ = nullptr;
+    };
+
+    class Node : public Link, public NodeHash<cacheHash> {
+    public:
+        T data_;
+
+        template<typename... Args>
+        Node(Args&& ...args) : data_(std::forward<Args>(args)...) {}
+    };
+
+    class iterator;
+
+    class const_iterator {
+    public:
+        const Node* currentNode = nullptr;
+        const_iterator& operator++() {currentNode = currentNode->next_; return *this;}
+        const_iterator operator++(int) {const_iterator other = *this; ++*this; return other;}
+        const_iterator(const Node* other) : currentNode(other) {}
+        const_iterator() {}
+        const_iterator(const iterator& other) : currentNode(other.currentNode) {}
+        bool operator==(const const_iterator& other) const {return currentNode == other.currentNode;}
+        bool operator!=(const const_iterator& other) const {return currentNode != other.currentNode;}
+        operator bool() const {return currentNode;}
+        const T& operator*() const {return currentNode->data_;}
+        const T* operator->() const {return &currentNode->data_;}
+    };
+
+    class iterator {
+    public:
+        Node* currentNode = nullptr;
+        iterator& operator++() {currentNode = currentNode->next_; return *this;}
+        iterator operator++(int) {iterator other = *this; ++*this; return other;}
+        iterator(Node* other) : currentNode(other) {}
+        iterator() {}
+        iterator(const const_iterator& other) : currentNode(const_cast<Node*>(other.currentNode)) {}
+        bool operator==(const iterator& other) const {return currentNode == other.currentNode;}
+        bool operator!=(const iterator& other) const {return currentNode != other.currentNode;}
+        operator bool() const {return currentNode;}
+        T& operator*() const {return currentNode->data_;}
+        T* operator->() const {return &currentNode->data_;}
+    };
+
+    using nodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
+private:
+    Link before_;
+    nodeAllocator nodeAlloc_;
+
+public:
+    explicit ForwardList(const Allocator& alloc = Allocator())
+        : nodeAlloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(alloc)) {}
+    ForwardList(const ForwardList&) = delete;
+    ForwardList(ForwardList&& other) : before_(other.before_), nodeAlloc_(std::move(other.nodeAlloc_)) {other.before_.next_ = nullptr;}
+    ForwardList& operator=(const ForwardList&) = delete;
+    // The lists trade their nodes and allocators, so each node is still freed by its own.
+    ForwardList& operator=(ForwardList&& other) {
+        std::swap(before_, other.before_);
+        std::swap(nodeAlloc_, other.nodeAlloc_);
+        return *this;
+    }
+    ~ForwardList() {clear();}
+
+    Link* beforeBegin() {return &before_;}
+    const Link* beforeBegin() const {return &before_;}
+    Node* first() const {return before_.next_;}
+    iterator begin() {return iterator(before_.next_);}
+    iterator end() {return iterator();}
+    const_iterator cbegin() const {return const_iterator(before_.next_);}
+    const_iterator cend() const {return const_iterator();}
+
+    // Builds an element node that belongs to no list yet; it is either linked or released with destroyNode().
+    template<typename... Args>
+    Node* createNode(Args&& ...args) {return allocateNode(nodeAlloc_, std::forward<Args>(args)...);}
+    void destroyNode(Node* ptr) {releaseNode(nodeAlloc_, ptr);}
+    // The same for nodes owned outside any list, by the given allocator.
+    template<typename... Args>
+    static Node* allocateNode(nodeAllocator& alloc, Args&& ...args);
+    static void releaseNode(nodeAllocator& alloc, Node* ptr);
+    const nodeAllocator& getNodeAllocator() const {return nodeAlloc_;}
+    static void linkAfter(Link* pos, Node* newNode) {newNode->next_ = pos->next_; pos->next_ = newNode;}
+    // Detaches the node after pos without destroying it.
+    static Node* unlinkAfter(Link* pos) {Node* answer = pos->next_; pos->next_ = answer->next_; return answer;}
+    void clear();
+
+    size_t trim() {return AllocatorTrim<nodeAllocator>::trim(nodeAlloc_);}
+    // Bytes held by the node allocator for live nodes.
+    size_t reservedBytes(size_t live) const {return AllocatorFootprint<nodeAllocator>::reservedBytes(nodeAlloc_, live);}
+    // Whether nodes of other, or nodes allocated by alloc, may be linked into this list and released by it.
+    bool sharesNodes(const ForwardList& other) const {return sharesNodes(other.nodeAlloc_);}
+    bool sharesNodes(const nodeAllocator& alloc) const;
+};
+
+template<typename T, typename Allocator, bool cacheHash>
+template<typename... Args>
+typename ForwardList<T, Allocator, cacheHash>::Node* ForwardList<T, Allocator, cacheHash>::allocateNode(nodeAllocator& alloc, Args&& ...args) {
+    Node* ptr = std::allocator_traits<nodeAllocator>::allocate(alloc, 1);
+    try {
+        std::allocator_traits<nodeAllocator>::construct(alloc, ptr, std::forward<Args>(args)...);
+    } catch (...) {
+        std::allocator_traits<nodeAllocator>::deallocate(alloc, ptr, 1);
+        throw;
+    }
+    return ptr;
+}
+
+template<typename T, typename Allocator, bool cacheHash>
+void ForwardList<T, Allocator, cacheHash>::releaseNode(nodeAllocator& alloc, Node* ptr) {
+    std::allocator_traits<nodeAllocator>::destroy(alloc, ptr);
+    std::allocator_traits<nodeAllocator>::deallocate(alloc, ptr, 1);
+}
+
+template<typename T, typename Allocator, bool cacheHash>
+void ForwardList<T, Allocator, cacheHash>::clear() {
+    while (before_.next_) {
+        destroyNode(unlinkAfter(&before_));
+    }
+}
+
+template<typename T, typename Allocator, bool cacheHash>
+bool ForwardList<T, Allocator, cacheHash>::sharesNodes(const nodeAllocator& alloc) const {
+    if constexpr (std::allocator_traits<nodeAllocator>::is_always_equal::value) {
+        return true;
+    } else {
+        return nodeAlloc_ == alloc;
+    }
+}